@@ -0,0 +1,403 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniform_buffer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// A spot or point light as model_lighting.fs evaluates it. A point light is a spot light whose cone
+// covers every direction (see Point).
+struct ClusterLight
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    float cutOff;      // cosines of the inner and outer cone angle
+    float outerCutOff;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    static ClusterLight Point(const glm::vec3 &position, const glm::vec3 &ambient, const glm::vec3 &diffuse,
+                              const glm::vec3 &specular, float constant, float linear, float quadratic)
+    {
+        // cutOff -1 and outerCutOff -2 put every direction inside the full intensity cone
+        return Spot(position, glm::vec3(0.0f, 0.0f, -1.0f), -1.0f, -2.0f, ambient, diffuse, specular,
+                    constant, linear, quadratic);
+    }
+
+    static ClusterLight Spot(const glm::vec3 &position, const glm::vec3 &direction, float cutOff, float outerCutOff,
+                             const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular,
+                             float constant, float linear, float quadratic)
+    {
+        ClusterLight light;
+        light.position = position;
+        light.direction = direction;
+        light.cutOff = cutOff;
+        light.outerCutOff = outerCutOff;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        return light;
+    }
+
+    bool IsSpot() const
+    {
+        return outerCutOff > -1.0f;
+    }
+};
+
+// Clustered forward light assignment. The view frustum is cut into GRID_X x GRID_Y screen tiles and
+// GRID_Z depth slices spaced exponentially between the near and far plane. Every frame Update bins each
+// light's bounding volume into the clusters it touches and uploads three buffer textures:
+//   lightData     - RGBA32F, TEXELS_PER_LIGHT texels per light (layout in Update)
+//   clusterLights - RG32UI, offset and count into lightIndices for each cluster
+//   lightIndices  - R32UI, the light lists of all clusters back to back
+// The fragment shader finds its cluster from its view position and only loops over that cluster's list,
+// so the cost per fragment depends on how many lights overlap it, not on how many lights there are.
+class ClusteredLights
+{
+public:
+    static const unsigned int GRID_X = 16;
+    static const unsigned int GRID_Y = 9;
+    static const unsigned int GRID_Z = 24;
+    static const unsigned int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const unsigned int TEXELS_PER_LIGHT = 5;
+
+    // texture units of the buffer textures, above anything a model material uses
+    static const unsigned int LIGHT_DATA_UNIT = 13;
+    static const unsigned int CLUSTER_LIGHTS_UNIT = 14;
+    static const unsigned int LIGHT_INDICES_UNIT = 15;
+
+    // a light stops affecting a cluster where its brightest term falls below this (one 8 bit step)
+    static constexpr float CUTOFF_INTENSITY = 1.0f / 256.0f;
+
+    // the lights to bin, edited freely between Updates
+    std::vector<ClusterLight> lights;
+
+    // optional, asked with each light's world space bounding sphere: a light it returns false for
+    // reaches nothing drawn with the clusters and is left out of them (and of Spheres)
+    std::function<bool(const glm::vec3 &center, float radius)> reachesGeometry;
+
+    ClusteredLights()
+        : paramsBuffer(CLUSTERS_BLOCK_BINDING)
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        static const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~ClusteredLights()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // sets the sampler uniforms of a program that includes the clustered lighting code
+    template <typename ShaderType>
+    static void BindSamplers(ShaderType &shader)
+    {
+        shader.use();
+        shader.setInt("lightData", LIGHT_DATA_UNIT);
+        shader.setInt("clusterLights", CLUSTER_LIGHTS_UNIT);
+        shader.setInt("lightIndices", LIGHT_INDICES_UNIT);
+    }
+
+    // bins the lights for this frame's camera, uploads the result and binds the buffer textures;
+    // fovY in radians, the same values that went into glm::perspective
+    void Update(const glm::mat4 &view, float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        if (fovY != cachedFovY || aspect != cachedAspect || nearPlane != cachedNear || farPlane != cachedFar)
+            buildClusterBounds(fovY, aspect, nearPlane, farPlane);
+
+        // 1. light data, and the pairs (cluster, light) of every cluster a light overlaps
+        lightTexels.resize(std::max<size_t>(lights.size(), 1) * TEXELS_PER_LIGHT);
+        spheres.assign(lights.size(), glm::vec4(0.0f));
+        pairs.clear();
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            const ClusterLight &light = lights[i];
+            glm::vec4 *texels = &lightTexels[i * TEXELS_PER_LIGHT];
+            texels[0] = glm::vec4(light.position, light.constant);
+            texels[1] = glm::vec4(light.direction, light.cutOff);
+            texels[2] = glm::vec4(light.ambient, light.linear);
+            texels[3] = glm::vec4(light.diffuse, light.quadratic);
+            texels[4] = glm::vec4(light.specular, light.outerCutOff);
+
+            glm::vec3 center;
+            float radius;
+            if (!boundingSphere(light, farPlane, center, radius))
+                continue;
+            if (reachesGeometry && !reachesGeometry(center, radius))
+                continue;
+            spheres[i] = glm::vec4(center, radius);
+            binSphere(glm::vec3(view * glm::vec4(center, 1.0f)), radius, (uint32_t)i);
+        }
+
+        // 2. counting sort of the pairs by cluster into compact per-cluster lists
+        clusterRanges.assign(CLUSTER_COUNT * 2, 0);
+        for (const Pair &pair : pairs)
+            clusterRanges[pair.cluster * 2 + 1]++;
+        uint32_t offset = 0;
+        for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+        {
+            clusterRanges[c * 2] = offset;
+            offset += clusterRanges[c * 2 + 1];
+        }
+        indices.resize(std::max<size_t>(pairs.size(), 1));
+        fill.assign(CLUSTER_COUNT, 0);
+        for (const Pair &pair : pairs)
+            indices[clusterRanges[pair.cluster * 2] + fill[pair.cluster]++] = pair.light;
+
+        // 3. upload, orphaning last frame's storage
+        upload(0, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        upload(1, clusterRanges.data(), clusterRanges.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint32_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        static const unsigned int units[3] = {LIGHT_DATA_UNIT, CLUSTER_LIGHTS_UNIT, LIGHT_INDICES_UNIT};
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // world space bounding sphere (center, radius) of every light as of the last Update, in the order
+    // of lights; radius 0 for a light too dim to reach anything or turned down by reachesGeometry
+    const std::vector<glm::vec4> &Spheres() const
+    {
+        return spheres;
+    }
+
+    // light/cluster assignments of the last Update, the total length of all light lists
+    unsigned int AssignedLights() const
+    {
+        return (unsigned int)pairs.size();
+    }
+
+private:
+    // std140 mirror of the Clusters block in model_lighting.fs
+    struct Params
+    {
+        float sliceScale; // slice = log(viewDepth) * sliceScale + sliceBias
+        float sliceBias;
+        int gridX, gridY, gridZ;
+        int padding[3];
+    };
+
+    struct Pair
+    {
+        uint32_t cluster;
+        uint32_t light;
+    };
+
+    struct Bounds
+    {
+        glm::vec3 min, max;
+    };
+
+    UniformBuffer<Params> paramsBuffer;
+    unsigned int buffers[3] = {}, textures[3] = {};
+
+    float cachedFovY = 0.0f, cachedAspect = 0.0f, cachedNear = 0.0f, cachedFar = 0.0f;
+    float tanHalfX = 0.0f, tanHalfY = 0.0f, sliceScale = 0.0f;
+    std::vector<Bounds> clusterBounds; // view space AABB of each cluster
+
+    std::vector<glm::vec4> lightTexels, spheres;
+    std::vector<Pair> pairs;
+    std::vector<uint32_t> clusterRanges, indices, fill;
+
+    static unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z)
+    {
+        return x + GRID_X * (y + GRID_Y * z);
+    }
+
+    float sliceDepth(unsigned int slice) const
+    {
+        return cachedNear * std::pow(cachedFar / cachedNear, (float)slice / GRID_Z);
+    }
+
+    void buildClusterBounds(float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        cachedFovY = fovY;
+        cachedAspect = aspect;
+        cachedNear = nearPlane;
+        cachedFar = farPlane;
+        tanHalfY = std::tan(fovY * 0.5f);
+        tanHalfX = tanHalfY * aspect;
+        sliceScale = GRID_Z / std::log(farPlane / nearPlane);
+
+        clusterBounds.resize(CLUSTER_COUNT);
+        for (unsigned int z = 0; z < GRID_Z; z++)
+        {
+            float depths[2] = {sliceDepth(z), sliceDepth(z + 1)};
+            for (unsigned int y = 0; y < GRID_Y; y++)
+            {
+                float ndcY[2] = {-1.0f + 2.0f * y / GRID_Y, -1.0f + 2.0f * (y + 1) / GRID_Y};
+                for (unsigned int x = 0; x < GRID_X; x++)
+                {
+                    float ndcX[2] = {-1.0f + 2.0f * x / GRID_X, -1.0f + 2.0f * (x + 1) / GRID_X};
+                    Bounds bounds;
+                    bounds.min = glm::vec3(INFINITY, INFINITY, -depths[1]);
+                    bounds.max = glm::vec3(-INFINITY, -INFINITY, -depths[0]);
+                    for (float depth : depths)
+                        for (int i = 0; i < 2; i++)
+                        {
+                            float viewX = ndcX[i] * depth * tanHalfX, viewY = ndcY[i] * depth * tanHalfY;
+                            bounds.min.x = std::min(bounds.min.x, viewX);
+                            bounds.max.x = std::max(bounds.max.x, viewX);
+                            bounds.min.y = std::min(bounds.min.y, viewY);
+                            bounds.max.y = std::max(bounds.max.y, viewY);
+                        }
+                    clusterBounds[clusterIndex(x, y, z)] = bounds;
+                }
+            }
+        }
+
+        Params params = {};
+        params.sliceScale = sliceScale;
+        params.sliceBias = -std::log(nearPlane) * sliceScale;
+        params.gridX = GRID_X;
+        params.gridY = GRID_Y;
+        params.gridZ = GRID_Z;
+        paramsBuffer.Upload(params);
+    }
+
+    // distance at which the light's brightest term drops below CUTOFF_INTENSITY, capped at maxRange
+    static float lightRange(const ClusterLight &light, float maxRange)
+    {
+        glm::vec3 peak = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+        float intensity = std::max(peak.x, std::max(peak.y, peak.z));
+        // solve constant + linear * d + quadratic * d^2 = intensity / cutoff
+        float c = light.constant - intensity / CUTOFF_INTENSITY;
+        if (c >= 0.0f)
+            return 0.0f;
+        float range;
+        if (light.quadratic > 0.0f)
+            range = (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+        else if (light.linear > 0.0f)
+            range = -c / light.linear;
+        else
+            range = maxRange;
+        return std::min(range, maxRange);
+    }
+
+    // world space sphere around everything the light reaches; for a spot light the smallest sphere
+    // around its cone (https://bartwronski.com/2017/04/13/cull-that-cone/)
+    static bool boundingSphere(const ClusterLight &light, float maxRange, glm::vec3 &center, float &radius)
+    {
+        float range = lightRange(light, maxRange);
+        if (range <= 0.0f)
+            return false;
+        center = light.position;
+        radius = range;
+        float cosAngle = light.outerCutOff;
+        // the ambient term isn't limited to the cone, and a cone of 90 degrees or more fits no better
+        bool hasAmbient = glm::dot(light.ambient, light.ambient) > 0.0f;
+        if (!light.IsSpot() || hasAmbient || cosAngle <= 0.0f)
+            return true;
+        glm::vec3 direction = glm::normalize(light.direction);
+        if (cosAngle < 0.70710678f) // wider than 45 degrees: the sphere through the rim of the cap
+        {
+            center = light.position + direction * (cosAngle * range);
+            radius = std::sqrt(1.0f - cosAngle * cosAngle) * range;
+        }
+        else // narrow: the sphere through the apex and the rim
+        {
+            radius = range / (2.0f * cosAngle);
+            center = light.position + direction * radius;
+        }
+        return true;
+    }
+
+    void binSphere(const glm::vec3 &center, float radius, uint32_t light)
+    {
+        // depth range of the sphere, view space looks down -z
+        float nearDepth = -center.z - radius, farDepth = -center.z + radius;
+        if (farDepth < cachedNear || nearDepth > cachedFar)
+            return;
+        nearDepth = std::max(nearDepth, cachedNear);
+        farDepth = std::min(farDepth, cachedFar);
+        int z0 = clampSlice((int)std::floor(std::log(nearDepth / cachedNear) * sliceScale));
+        int z1 = clampSlice((int)std::floor(std::log(farDepth / cachedNear) * sliceScale));
+
+        // screen rectangle: x / depth is monotonic in both, so the extremes are at the box corners
+        float ndc[4] = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+        for (float depth : {nearDepth, farDepth})
+            for (float sign : {-1.0f, 1.0f})
+            {
+                float x = (center.x + sign * radius) / (depth * tanHalfX);
+                float y = (center.y + sign * radius) / (depth * tanHalfY);
+                ndc[0] = std::min(ndc[0], x);
+                ndc[1] = std::min(ndc[1], y);
+                ndc[2] = std::max(ndc[2], x);
+                ndc[3] = std::max(ndc[3], y);
+            }
+        if (ndc[0] > 1.0f || ndc[1] > 1.0f || ndc[2] < -1.0f || ndc[3] < -1.0f)
+            return;
+        int x0 = tile(ndc[0], GRID_X), x1 = tile(ndc[2], GRID_X);
+        int y0 = tile(ndc[1], GRID_Y), y1 = tile(ndc[3], GRID_Y);
+
+        float radiusSquared = radius * radius;
+        for (int z = z0; z <= z1; z++)
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                {
+                    unsigned int cluster = clusterIndex(x, y, z);
+                    const Bounds &bounds = clusterBounds[cluster];
+                    glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radiusSquared)
+                        pairs.push_back(Pair{cluster, light});
+                }
+    }
+
+    static int clampSlice(int slice)
+    {
+        return std::min(std::max(slice, 0), (int)GRID_Z - 1);
+    }
+
+    static int tile(float ndc, unsigned int tiles)
+    {
+        int index = (int)std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return std::min(std::max(index, 0), (int)tiles - 1);
+    }
+
+    void upload(int buffer, const void *data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef CONE_STEP_MAP_H
+#define CONE_STEP_MAP_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <learnopengl/ktx.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CONE_STEP_MAP_SSE
+#include <xmmintrin.h>
+#endif
+
+// Relaxed cone step maps (Policarpo and Oliveira, "Relaxed Cone Stepping for Relief Mapping", GPU Gems 3)
+// for the CONE_STEP_MAPPING variant of parallax_mapping.fs. Every texel stores its depth and the ratio
+// (texture space distance per unit of depth) of a cone standing on the surface there and opening
+// upward. A ray marching through the depth map can step to the rim of the cone under it in one go:
+// the cone is as wide as it can be while any ray through it still crosses the surface at most once,
+// so a handful of steps either stay above the surface or end just past the first hit, and a short
+// binary search finishes the job.
+//
+// The relaxed cone at p is limited by the surface points visible from the top of p (depth 0): a ray
+// from there down to such a point q hits nothing before q, and the cone must not reach past it, so
+// its ratio is at most dist(p, q) / (depth(p) - depth(q)). Build walks DIRECTIONS rays outward from
+// every texel, tracking the horizon to tell visible points from hidden ones, four directions at a
+// time with SSE and the rows spread over ThreadPool::Shared(). The walk stops after SEARCH_RADIUS
+// texels, with the cone capped so nothing farther out could fall inside it.
+//
+// Build has no GL calls, Load does the rest on the GL thread: the first run builds the map from the
+// height map and writes <image>.cone.ktx next to it, later runs read that file.
+class ConeStepMap
+{
+public:
+    // the map is built at most this large per side, a larger height map is box filtered down first
+    static const int MAX_SIZE = 1024;
+    static const int SEARCH_RADIUS = 64;
+    static const int DIRECTIONS = 32;
+
+    // depth is row major in [0, 1], 1 the deepest; rg receives two bytes per texel, the depth and the
+    // square root of the cone ratio (more precision for the narrow cones), both rounded so the cone
+    // only ever gets narrower
+    static void Build(const std::vector<float> &depth, int width, int height, std::vector<unsigned char> &rg)
+    {
+        // nearest texel along each direction for every step, as offsets into a grid padded by the
+        // search radius on all sides so the walk needs no clamping
+        const int pad = SEARCH_RADIUS;
+        const int stride = width + 2 * pad;
+        std::vector<float> padded((size_t)stride * (height + 2 * pad));
+        for (int y = -pad; y < height + pad; y++)
+        {
+            int sourceY = std::min(std::max(y, 0), height - 1);
+            for (int x = -pad; x < width + pad; x++)
+            {
+                int sourceX = std::min(std::max(x, 0), width - 1);
+                padded[(size_t)(y + pad) * stride + x + pad] = depth[(size_t)sourceY * width + sourceX];
+            }
+        }
+        // per step and direction (directions innermost, as the SSE loop loads them): the offset and the
+        // texture space distance it stands for
+        std::vector<int> offsets(SEARCH_RADIUS * DIRECTIONS);
+        std::vector<float> distances(SEARCH_RADIUS * DIRECTIONS);
+        for (int step = 0; step < SEARCH_RADIUS; step++)
+        {
+            for (int direction = 0; direction < DIRECTIONS; direction++)
+            {
+                float angle = 6.28318530718f * direction / DIRECTIONS;
+                int dx = (int)std::lround((step + 1) * std::cos(angle)), dy = (int)std::lround((step + 1) * std::sin(angle));
+                offsets[step * DIRECTIONS + direction] = dy * stride + dx;
+                distances[step * DIRECTIONS + direction] = std::sqrt((float)(dx * dx) / ((float)width * width) + (float)(dy * dy) / ((float)height * height));
+            }
+        }
+        // nothing past the search radius is closer than this
+        float searched = (float)SEARCH_RADIUS / std::max(width, height);
+
+        rg.resize((size_t)width * height * 2);
+        ThreadPool::Shared().ParallelFor((unsigned int)height, [&](unsigned int y) {
+            for (int x = 0; x < width; x++)
+            {
+                size_t center = (size_t)(y + pad) * stride + x + pad;
+                float apex = padded[center];
+                float ratio = apex > 0.0f ? std::min(1.0f, searched / apex) : 1.0f;
+                if (apex > 0.0f)
+                    ratio = std::min(ratio, coneRatio(&padded[center], apex, offsets.data(), distances.data(), ratio));
+
+                unsigned char *texel = &rg[((size_t)y * width + x) * 2];
+                texel[0] = (unsigned char)std::lround(std::min(std::max(apex, 0.0f), 1.0f) * 255.0f);
+                texel[1] = (unsigned char)std::floor(std::sqrt(ratio) * 255.0f);
+            }
+        });
+    }
+
+    // the cone step map of a height map as a GL_RG8 texture with linear filtering and no mipmaps (a
+    // cone averaged with wider ones further down the chain would no longer hold), 0 if the image
+    // can't be read
+    static unsigned int Load(const std::string &path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<unsigned char> bytes;
+        if (!TextureCache::ReadFile(path, bytes))
+        {
+            std::cout << "Cone step map failed to load at path: " << path << std::endl;
+            return 0;
+        }
+        // a new version of the builder makes the old files stale
+        uint64_t sourceHash = TextureCache::HashContents(bytes, false) * 31 + VERSION;
+
+        std::string conePath = path + ".cone.ktx";
+        KtxImage image;
+        bool cached = KtxFile::Load(conePath, sourceHash, image) && image.glInternalFormat == GL_RG8 && image.levels.size() == 1
+                      && image.levels[0].size() == (size_t)image.width * image.height * 2;
+        if (!cached)
+        {
+            int width = 0, height = 0, components = 0;
+            // this stb_image has no 16 bit decode from memory, the file is read again (only when building)
+            stbi_us *pixels = stbi_load_16(path.c_str(), &width, &height, &components, 1);
+            if (!pixels)
+            {
+                std::cout << "Cone step map failed to load at path: " << path << std::endl;
+                return 0;
+            }
+            std::vector<float> depth;
+            downsample(pixels, width, height, depth);
+            stbi_image_free(pixels);
+
+            image = KtxImage();
+            image.glType = GL_UNSIGNED_BYTE;
+            image.glFormat = GL_RG;
+            image.glInternalFormat = GL_RG8;
+            image.glBaseInternalFormat = GL_RG;
+            image.width = (uint32_t)width;
+            image.height = (uint32_t)height;
+            image.levels.resize(1);
+            Build(depth, width, height, image.levels[0]);
+            if (!KtxFile::Save(conePath, image, sourceHash))
+                std::cout << "Cone step map could not be written at path: " << conePath << std::endl;
+        }
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // two bytes per texel, rows of an odd width aren't 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, image.width, image.height, 0, GL_RG, GL_UNSIGNED_BYTE, image.levels[0].data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        std::cout << "PARALLAX:: cone step map " << image.width << "x" << image.height << (cached ? " read from " : " built for ")
+                  << path << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+        return texture;
+    }
+
+private:
+    static const uint64_t VERSION = 1;
+
+    // the narrowest cone at the texel at apex (depth apex) that the walk finds, starting from limit
+    static float coneRatio(const float *apex, float apexDepth, const int *offsets, const float *distances, float limit)
+    {
+        float best = limit;
+#ifdef CONE_STEP_MAP_SSE
+        const __m128 depth = _mm_set1_ps(apexDepth);
+        for (int group = 0; group < DIRECTIONS; group += 4)
+        {
+            // lowest depth per distance seen so far in each direction: a point is visible from the top
+            // of the apex if its own ratio is no larger
+            __m128 horizon = _mm_set1_ps(FLT_MAX);
+            __m128 narrowest = _mm_set1_ps(best);
+            for (int step = 0; step < SEARCH_RADIUS; step++)
+            {
+                const int *offset = offsets + step * DIRECTIONS + group;
+                const float *distance = distances + step * DIRECTIONS + group;
+                // every candidate is at least distance / apexDepth, so farther steps can't beat best
+                if (distance[0] > best * apexDepth && distance[1] > best * apexDepth && distance[2] > best * apexDepth
+                    && distance[3] > best * apexDepth)
+                    break;
+                __m128 surface = _mm_set_ps(apex[offset[3]], apex[offset[2]], apex[offset[1]], apex[offset[0]]);
+                __m128 along = _mm_loadu_ps(distance);
+                __m128 slope = _mm_div_ps(surface, along);
+                __m128 visible = _mm_cmple_ps(slope, horizon);
+                horizon = _mm_min_ps(horizon, slope);
+                __m128 above = _mm_cmplt_ps(surface, depth);
+                __m128 candidate = _mm_div_ps(along, _mm_sub_ps(depth, surface));
+                __m128 mask = _mm_and_ps(visible, above);
+                candidate = _mm_or_ps(_mm_and_ps(mask, candidate), _mm_andnot_ps(mask, narrowest));
+                narrowest = _mm_min_ps(narrowest, candidate);
+                if ((step & 7) == 7)
+                    best = std::min(best, horizontalMin(narrowest));
+            }
+            best = std::min(best, horizontalMin(narrowest));
+        }
+#else
+        for (int direction = 0; direction < DIRECTIONS; direction++)
+        {
+            float horizon = FLT_MAX;
+            for (int step = 0; step < SEARCH_RADIUS; step++)
+            {
+                float distance = distances[step * DIRECTIONS + direction];
+                if (distance > best * apexDepth)
+                    break;
+                float surface = apex[offsets[step * DIRECTIONS + direction]];
+                float slope = surface / distance;
+                bool visible = slope <= horizon;
+                horizon = std::min(horizon, slope);
+                if (visible && surface < apexDepth)
+                    best = std::min(best, distance / (apexDepth - surface));
+            }
+        }
+#endif
+        return best;
+    }
+
+#ifdef CONE_STEP_MAP_SSE
+    static float horizontalMin(__m128 values)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, values);
+        return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    }
+#endif
+
+    // 16 bit depth to floats, box filtered by a whole factor until no side is over MAX_SIZE; width and
+    // height become the size of the result
+    static void downsample(const stbi_us *pixels, int &width, int &height, std::vector<float> &depth)
+    {
+        int factor = 1;
+        while (std::max(width, height) / factor > MAX_SIZE)
+            factor *= 2;
+        int outWidth = std::max(1, width / factor), outHeight = std::max(1, height / factor);
+        depth.assign((size_t)outWidth * outHeight, 0.0f);
+        for (int y = 0; y < outHeight; y++)
+        {
+            for (int x = 0; x < outWidth; x++)
+            {
+                float sum = 0.0f;
+                for (int sy = 0; sy < factor; sy++)
+                    for (int sx = 0; sx < factor; sx++)
+                        sum += pixels[(size_t)(y * factor + sy) * width + x * factor + sx];
+                // quantized the way the map stores it, so the cones fit the depth the shader reads
+                depth[(size_t)y * outWidth + x] = std::round(sum / (factor * factor) / 65535.0f * 255.0f) / 255.0f;
+            }
+        }
+        width = outWidth;
+        height = outHeight;
+    }
+};
+
+#endif
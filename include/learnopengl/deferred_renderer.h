@@ -0,0 +1,238 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/shadow_maps.h>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Deferred shading for the lit models. The geometry pass (gbuffer.fs behind the usual model vertex
+// shaders) writes world position, normal and albedo + specular into a G-buffer, and LightingPass shades
+// every covered pixel once, however much overdraw the geometry had:
+//   - a full-screen pass for the directional light, shadowed by the CascadedShadowMaps bound at the
+//     time (and black at night),
+//   - at night one instanced draw of the bounding spheres of all ClusteredLights lights, additively
+//     blended, so each light only touches the pixels inside its volume.
+// Afterwards the G-buffer depth is in the default framebuffer, so forward passes drawn after it are
+// depth tested against the models as usual.
+//
+// The G-buffer keeps only the red channel of the specular map, so the deferred sun shades with a
+// scalar specular intensity where forward CalcDirLight uses the map's full colour; a coloured specular
+// map looks different between the two paths. (Forward CalcLight already takes .xxx, the deferred
+// point and spot lights match it.)
+class DeferredRenderer
+{
+public:
+    // texture units of the G-buffer in the lighting passes
+    static const unsigned int POSITION_UNIT = 0;
+    static const unsigned int NORMAL_UNIT = 1;
+    static const unsigned int ALBEDO_SPEC_UNIT = 2;
+
+    DeferredRenderer(int width, int height)
+        : directionalShader("resources/shaders/deferred_screen.vs", "resources/shaders/deferred_directional.fs"),
+          lightVolumeShader("resources/shaders/deferred_light.vs", "resources/shaders/deferred_light.fs")
+    {
+        for (Shader *shader : {&directionalShader, &lightVolumeShader})
+        {
+            shader->use();
+            shader->setInt("gPosition", POSITION_UNIT);
+            shader->setInt("gNormal", NORMAL_UNIT);
+            shader->setInt("gAlbedoSpec", ALBEDO_SPEC_UNIT);
+            shader->setFloat("shininess", 32.0f);
+        }
+        lightVolumeShader.setInt("lightData", ClusteredLights::LIGHT_DATA_UNIT);
+        CascadedShadowMaps::BindSamplers(directionalShader);
+
+        glGenFramebuffers(1, &gBuffer);
+        glGenTextures(3, attachments);
+        glGenRenderbuffers(1, &depthBuffer);
+        Resize(width, height);
+
+        // the core profile wants a VAO bound even when the vertex shader makes up its own vertices
+        glGenVertexArrays(1, &screenVAO);
+        setupSphere();
+    }
+
+    ~DeferredRenderer()
+    {
+        glDeleteFramebuffers(1, &gBuffer);
+        glDeleteTextures(3, attachments);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteVertexArrays(1, &screenVAO);
+        glDeleteVertexArrays(1, &sphereVAO);
+        glDeleteBuffers(1, &sphereVBO);
+        glDeleteBuffers(1, &sphereEBO);
+        glDeleteBuffers(1, &instanceVBO);
+    }
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    // (re)allocates the G-buffer when the framebuffer size changed
+    void Resize(int newWidth, int newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        // positions are world space, hundreds to thousands of units out, too far for half floats. RGBA
+        // even where alpha goes unused: GL 3.3 doesn't require the three channel float formats to be
+        // color-renderable
+        static const GLint internalFormats[3] = {GL_RGBA32F, GL_RGBA16F, GL_RGBA8};
+        static const GLenum formats[3] = {GL_RGBA, GL_RGBA, GL_RGBA};
+        static const GLenum types[3] = {GL_FLOAT, GL_FLOAT, GL_UNSIGNED_BYTE};
+        for (int i = 0; i < 3; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, attachments[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, attachments[i], 0);
+        }
+        static const GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, drawBuffers);
+
+        // same format as the default framebuffer's depth, so it can be blitted over after lighting
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED:: G-buffer framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // binds and clears the G-buffer; draw the models with the gbuffer.fs programs until LightingPass
+    void BeginGeometryPass()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // shades the G-buffer into the default framebuffer and copies its depth there; expects the Camera
+    // and Lights blocks and the ClusteredLights buffers of this frame to be up to date
+    void LightingPass(const ClusteredLights &lights, bool night)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + POSITION_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, attachments[i]);
+        }
+
+        // directional light, every pixel the geometry pass covered
+        glDisable(GL_DEPTH_TEST);
+        directionalShader.use();
+        glBindVertexArray(screenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        if (night && !lights.Spheres().empty())
+        {
+            // back faces that lie behind the stored surface: the surface is inside or in front of the
+            // volume, the rest of the screen is rejected by the depth test. Back faces past the far
+            // plane (the dodge headlights reach thousands of units) are clamped to it instead of
+            // clipped, they still pass GL_GEQUAL there
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_DEPTH_CLAMP);
+            glDepthFunc(GL_GEQUAL);
+            glDepthMask(GL_FALSE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+
+            const std::vector<glm::vec4> &spheres = lights.Spheres();
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, spheres.size() * sizeof(glm::vec4), spheres.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            lightVolumeShader.use();
+            glBindVertexArray(sphereVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)spheres.size());
+
+            glDisable(GL_DEPTH_CLAMP);
+            glDisable(GL_BLEND);
+            glCullFace(GL_BACK);
+            glDisable(GL_CULL_FACE);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        }
+        glEnable(GL_DEPTH_TEST);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    static const int SPHERE_SEGMENTS = 16;
+    static const int SPHERE_RINGS = 8;
+
+    Shader directionalShader, lightVolumeShader;
+    int width = 0, height = 0;
+    unsigned int gBuffer = 0, depthBuffer = 0;
+    unsigned int attachments[3] = {}; // position, normal, albedo + specular
+    unsigned int screenVAO = 0, sphereVAO = 0, sphereVBO = 0, sphereEBO = 0, instanceVBO = 0;
+    unsigned int sphereIndexCount = 0;
+
+    // UV sphere around the unit sphere: the vertices are pushed out so even the middle of the flat
+    // faces stays outside radius 1 and a volume never clips its light
+    void setupSphere()
+    {
+        const float PI = 3.14159265359f;
+        float scale = 1.0f / (std::cos(PI / SPHERE_SEGMENTS) * std::cos(PI / (2 * SPHERE_RINGS)));
+        std::vector<glm::vec3> vertices;
+        for (int ring = 0; ring <= SPHERE_RINGS; ring++)
+        {
+            float theta = PI * ring / SPHERE_RINGS;
+            for (int segment = 0; segment <= SPHERE_SEGMENTS; segment++)
+            {
+                float phi = 2.0f * PI * segment / SPHERE_SEGMENTS;
+                vertices.push_back(scale * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+            }
+        }
+        // counter-clockwise seen from outside
+        std::vector<unsigned int> indices;
+        for (int ring = 0; ring < SPHERE_RINGS; ring++)
+            for (int segment = 0; segment < SPHERE_SEGMENTS; segment++)
+            {
+                unsigned int a = ring * (SPHERE_SEGMENTS + 1) + segment, b = a + SPHERE_SEGMENTS + 1;
+                indices.insert(indices.end(), {a, a + 1, b, b, a + 1, b + 1});
+            }
+        sphereIndexCount = (unsigned int)indices.size();
+
+        glGenVertexArrays(1, &sphereVAO);
+        glGenBuffers(1, &sphereVBO);
+        glGenBuffers(1, &sphereEBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(sphereVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+        // per light: bounding sphere center and radius
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif
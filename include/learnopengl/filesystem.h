@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstdlib>
+#include <climits>
 #include "root_directory.h" // This is a configuration file generated by CMake.
 
 class FileSystem
@@ -17,6 +18,16 @@ public:
     return (*pathBuilder)(path);
   }
 
+  // resolves '.', '..' and symlinks so that two spellings of the same file compare equal;
+  // falls back to the given path when the file can't be resolved
+  static std::string getCanonicalPath(const std::string& path)
+  {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == nullptr)
+      return path;
+    return std::string(resolved);
+  }
+
 private:
   static std::string const & getRoot()
   {
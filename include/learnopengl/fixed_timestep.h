@@ -0,0 +1,58 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <algorithm>
+#include <cmath>
+
+// Steps a simulation at a fixed rate whatever the frame rate ("Fix Your Timestep!", Glenn Fiedler).
+// Every frame adds its duration to an accumulator and Advance returns how many whole steps fit in it;
+// the caller runs that many, keeping the state before the last one. What is left over, Alpha, is how
+// far the frame is between those two states, so drawing the mix of them moves things smoothly at any
+// frame rate, one step behind the simulation at most.
+//
+// A frame longer than maxSteps steps (a stall, a breakpoint) runs maxSteps and drops the rest, so a
+// slow frame never makes the next one slower still.
+class FixedTimestep
+{
+public:
+    explicit FixedTimestep(double rate, unsigned int maxSteps = 8)
+        : step(1.0 / rate), maxSteps(maxSteps)
+    {
+    }
+
+    // number of steps to run for a frame of frameSeconds
+    unsigned int Advance(double frameSeconds)
+    {
+        accumulator += std::max(frameSeconds, 0.0);
+        unsigned int steps = (unsigned int)std::min(std::floor(accumulator / step), (double)maxSteps);
+        accumulator = std::min(accumulator - steps * step, step);
+        total += steps;
+        return steps;
+    }
+
+    // between 0 (the state before the last step) and 1 (the state after it)
+    float Alpha() const
+    {
+        return (float)std::min(accumulator / step, 1.0);
+    }
+
+    // seconds per step
+    float Step() const
+    {
+        return (float)step;
+    }
+
+    // steps run since the caller last reset them
+    unsigned long &Steps()
+    {
+        return total;
+    }
+
+private:
+    double step;
+    unsigned int maxSteps;
+    double accumulator = 0.0;
+    unsigned long total = 0;
+};
+
+#endif
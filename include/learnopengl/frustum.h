@@ -0,0 +1,257 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+// Axis aligned bounding box. A default constructed box is empty (min above max) and grows with Extend.
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool IsEmpty() const
+    {
+        return min.x > max.x;
+    }
+
+    void Extend(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Extend(const BoundingBox &box)
+    {
+        if (box.IsEmpty())
+            return;
+        Extend(box.min);
+        Extend(box.max);
+    }
+
+    glm::vec3 Center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    // half the size along each axis
+    glm::vec3 Extents() const
+    {
+        return (max - min) * 0.5f;
+    }
+
+    // sphere around the box, center in xyz and radius in w
+    glm::vec4 Sphere() const
+    {
+        return glm::vec4(Center(), glm::length(Extents()));
+    }
+
+    // the box around this box moved by an affine transform (Arvo): the center is transformed as a
+    // point, the extents by the absolute values of the rotation/scale part
+    BoundingBox Transformed(const glm::mat4 &transform) const
+    {
+        if (IsEmpty())
+            return *this;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 newExtents = glm::abs(glm::vec3(transform[0])) * extents.x
+                             + glm::abs(glm::vec3(transform[1])) * extents.y
+                             + glm::abs(glm::vec3(transform[2])) * extents.z;
+        BoundingBox box;
+        box.min = center - newExtents;
+        box.max = center + newExtents;
+        return box;
+    }
+};
+
+// the six planes of a view frustum, world space if built from projection * view
+struct Frustum
+{
+    // left, right, bottom, top, near, far; xyz is the unit normal pointing inside, w the offset
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann: every plane is the last row of the matrix plus or minus one of the others
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        for (int i = 0; i < 3; i++)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4 &plane : planes)
+            plane = plane / glm::length(glm::vec3(plane));
+    }
+
+    // false only if the box lies entirely outside one plane; boxes near a frustum corner may pass
+    bool Intersects(const BoundingBox &box) const
+    {
+        if (box.IsEmpty())
+            return false;
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        for (const glm::vec4 &plane : planes)
+        {
+            glm::vec3 normal = glm::vec3(plane);
+            if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extents) < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    enum Containment
+    {
+        OUTSIDE,
+        INTERSECTING,
+        INSIDE
+    };
+
+    // like Intersects, but also tells a box entirely inside every plane apart, so a hierarchy can
+    // accept a whole subtree without testing its children
+    Containment Classify(const BoundingBox &box) const
+    {
+        if (box.IsEmpty())
+            return OUTSIDE;
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        Containment result = INSIDE;
+        for (const glm::vec4 &plane : planes)
+        {
+            glm::vec3 normal = glm::vec3(plane);
+            float distance = glm::dot(normal, center) + plane.w;
+            float radius = glm::dot(glm::abs(normal), extents);
+            if (distance + radius < 0.0f)
+                return OUTSIDE;
+            if (distance - radius < 0.0f)
+                result = INTERSECTING;
+        }
+        return result;
+    }
+};
+
+// Tests a frame's worth of world space boxes against the view frustum in one batch. Between Begin and
+// Run the boxes are only collected, as centers and extents in separate arrays, so that Run can test four
+// of them per iteration with SSE (plain Frustum::Intersects where SSE isn't available). Each box comes
+// with the flag Run sets to 1 if it is visible and 0 if not.
+class FrustumCuller
+{
+public:
+    FrustumCuller()
+        : frustum(glm::mat4(1.0f))
+    {
+    }
+
+    void Begin(const glm::mat4 &viewProjection)
+    {
+        frustum = Frustum(viewProjection);
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+        results.clear();
+        visibleCount = culledCount = 0;
+    }
+
+    // visible has to stay valid until Run; an empty box has nothing to draw and is culled right away
+    void Add(const BoundingBox &box, unsigned char *visible)
+    {
+        if (box.IsEmpty())
+        {
+            *visible = 0;
+            return;
+        }
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+        results.push_back(visible);
+    }
+
+    // tests every box added since Begin and writes the results
+    void Run()
+    {
+        size_t count = results.size();
+#ifdef FRUSTUM_CULLER_SSE
+        // pad to whole groups of four, the padding lanes are never written back
+        size_t padded = (count + 3) & ~size_t(3);
+        for (std::vector<float> *values : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            values->resize(padded, 0.0f);
+
+        __m128 normalX[6], normalY[6], normalZ[6], absX[6], absY[6], absZ[6], offset[6];
+        for (int p = 0; p < 6; p++)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            normalX[p] = _mm_set1_ps(plane.x);
+            normalY[p] = _mm_set1_ps(plane.y);
+            normalZ[p] = _mm_set1_ps(plane.z);
+            absX[p] = _mm_set1_ps(std::fabs(plane.x));
+            absY[p] = _mm_set1_ps(std::fabs(plane.y));
+            absZ[p] = _mm_set1_ps(std::fabs(plane.z));
+            offset[p] = _mm_set1_ps(plane.w);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < padded; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++)
+            {
+                // signed distance of the center plus the box's projected radius onto the normal
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, normalX[p]), _mm_mul_ps(cy, normalY[p])),
+                                             _mm_add_ps(_mm_mul_ps(cz, normalZ[p]), offset[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, absX[p]), _mm_mul_ps(ey, absY[p])), _mm_mul_ps(ez, absZ[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (size_t lane = 0; lane < 4 && i + lane < count; lane++)
+                *results[i + lane] = (unsigned char)((mask >> lane) & 1);
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            BoundingBox box;
+            glm::vec3 center(centerX[i], centerY[i], centerZ[i]), extents(extentX[i], extentY[i], extentZ[i]);
+            box.min = center - extents;
+            box.max = center + extents;
+            *results[i] = frustum.Intersects(box) ? 1 : 0;
+        }
+#endif
+        for (unsigned char *visible : results)
+        {
+            if (*visible)
+                visibleCount++;
+            else
+                culledCount++;
+        }
+    }
+
+    const Frustum &GetFrustum() const
+    {
+        return frustum;
+    }
+
+    // results of the last Run
+    unsigned int Visible() const
+    {
+        return visibleCount;
+    }
+
+    unsigned int Culled() const
+    {
+        return culledCount;
+    }
+
+private:
+    Frustum frustum;
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+    std::vector<unsigned char*> results;
+    unsigned int visibleCount = 0, culledCount = 0;
+};
+
+#endif
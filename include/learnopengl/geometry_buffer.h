@@ -0,0 +1,297 @@
+#ifndef GEOMETRY_BUFFER_H
+#define GEOMETRY_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// the layout a Vertex is uploaded in, 20 bytes instead of 56; model_lighting*.vs decode it
+struct PackedVertex {
+    // position relative to the mesh bounds, 0..65535 per axis, and the handedness of the tangent frame
+    // in the fourth value: 65535 if the bitangent is cross(normal, tangent), 0 if it points the other way
+    uint16_t Position[4];
+    // unit vectors, octahedral encoded as two signed normalized values
+    int16_t Normal[2];
+    int16_t Tangent[2];
+    // half floats
+    uint16_t TexCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex has to match the attribute setup in GeometryBuffer");
+
+// Vertex and index storage shared by all meshes. Meshes are suballocated from a few large pages, each
+// one vertex buffer and one index buffer behind a single VAO with the PackedVertex attributes, and drawn
+// with the *BaseVertex calls, so their indices stay relative to their own first vertex. A mesh too large
+// for a page gets a page of its own size. Going from mesh to mesh thus only changes the VAO when the
+// page changes: Bind leaves the page's VAO bound and skips the call if it already is, so whoever draws
+// with another VAO afterwards calls Unbind first (or binds it through BindVertexArray, or calls Forget
+// after binding it directly).
+//
+// Everything here runs on the GL thread. Uploads go through GL_COPY_WRITE_BUFFER, so they never disturb
+// the element buffer binding of whatever VAO happens to be bound.
+class GeometryBuffer
+{
+public:
+    // where one mesh lives
+    struct Allocation
+    {
+        int page = -1;
+        unsigned int baseVertex = 0; // of the mesh's first vertex in the page's vertex buffer
+        unsigned int vertexCount = 0;
+        size_t indexOffset = 0;      // bytes into the page's index buffer
+        size_t indexBytes = 0;
+
+        bool IsValid() const
+        {
+            return page >= 0;
+        }
+    };
+
+    // vertices and indices per page, unless one mesh needs more
+    static const unsigned int PAGE_VERTICES = 1u << 20;
+    static const size_t PAGE_INDEX_BYTES = 16u << 20;
+
+    static Allocation Allocate(const PackedVertex *vertices, unsigned int vertexCount, const void *indices, size_t indexBytes)
+    {
+        std::vector<Page> &all = pages();
+        Allocation allocation;
+        size_t vertexOffset = 0;
+        for (size_t i = 0; i < all.size() && !allocation.IsValid(); i++)
+        {
+            Page &page = all[i];
+            if (!page.vertexSpace.Allocate(vertexCount, 1, vertexOffset))
+                continue;
+            if (!page.indexSpace.Allocate(indexBytes, INDEX_ALIGNMENT, allocation.indexOffset))
+            {
+                page.vertexSpace.Free(vertexOffset, vertexCount);
+                continue;
+            }
+            allocation.page = (int)i;
+        }
+        if (!allocation.IsValid())
+        {
+            size_t pageVertices = PAGE_VERTICES, pageIndexBytes = PAGE_INDEX_BYTES;
+            all.push_back(createPage(std::max<size_t>(vertexCount, pageVertices), std::max(indexBytes, pageIndexBytes)));
+            Page &page = all.back();
+            page.vertexSpace.Allocate(vertexCount, 1, vertexOffset);
+            page.indexSpace.Allocate(indexBytes, INDEX_ALIGNMENT, allocation.indexOffset);
+            allocation.page = (int)all.size() - 1;
+        }
+        allocation.baseVertex = (unsigned int)vertexOffset;
+        allocation.vertexCount = vertexCount;
+        allocation.indexBytes = indexBytes;
+
+        const Page &page = all[allocation.page];
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(PackedVertex), vertexCount * sizeof(PackedVertex), vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexBytes, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    static void Free(Allocation &allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+        Page &page = pages()[allocation.page];
+        page.vertexSpace.Free(allocation.baseVertex, allocation.vertexCount);
+        page.indexSpace.Free(allocation.indexOffset, allocation.indexBytes);
+        allocation = Allocation();
+    }
+
+    static void Bind(int page)
+    {
+        BindVertexArray(pages()[page].vao);
+    }
+
+    static void Unbind()
+    {
+        if (boundVertexArray() == 0)
+            return;
+        glBindVertexArray(0);
+        boundVertexArray() = 0;
+    }
+
+    // binds any VAO through the same bookkeeping, skipping the call if it is already bound; false if it was
+    static bool BindVertexArray(unsigned int vao)
+    {
+        if (vao == boundVertexArray())
+            return false;
+        glBindVertexArray(vao);
+        boundVertexArray() = vao;
+        VertexArrayBinds()++;
+        return true;
+    }
+
+    // after code that binds its VAOs directly: the next bind can't be skipped
+    static void Forget()
+    {
+        boundVertexArray() = UNKNOWN_VERTEX_ARRAY;
+    }
+
+    static unsigned int VertexArray(int page)
+    {
+        return pages()[page].vao;
+    }
+
+    // binds the page and points its instance attributes 5-8 at a buffer with one mat4 per instance,
+    // starting at firstInstance; GL 3.3 has no base instance, so that is an offset of the pointers
+    static void BindInstanced(int page, unsigned int instanceBuffer, unsigned int firstInstance)
+    {
+        Bind(page);
+        Page &bound = pages()[page];
+        if (bound.instanceBuffer == instanceBuffer && bound.firstInstance == firstInstance)
+            return;
+        // a mat4 attribute takes four consecutive locations, one per column
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                                  (void*)((firstInstance * 16 + column * 4) * sizeof(float)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bound.instanceBuffer = instanceBuffer;
+        bound.firstInstance = firstInstance;
+    }
+
+    // VAO binds since the caller last reset it
+    static unsigned long &VertexArrayBinds()
+    {
+        static unsigned long binds = 0;
+        return binds;
+    }
+
+    static unsigned int Pages()
+    {
+        return (unsigned int)pages().size();
+    }
+
+private:
+    static const unsigned int UNKNOWN_VERTEX_ARRAY = ~0u;
+    // 16 and 32 bit index lists share the index buffers, every one starts 4 byte aligned
+    static const size_t INDEX_ALIGNMENT = 4;
+
+    // free ranges of a buffer as (offset, size), sorted by offset and never touching each other
+    struct FreeList
+    {
+        std::vector<std::pair<size_t, size_t>> ranges;
+
+        explicit FreeList(size_t size)
+            : ranges(1, std::make_pair((size_t)0, size))
+        {
+        }
+
+        // first fit
+        bool Allocate(size_t size, size_t alignment, size_t &offset)
+        {
+            if (size == 0)
+            {
+                offset = 0;
+                return true;
+            }
+            for (size_t i = 0; i < ranges.size(); i++)
+            {
+                size_t start = ranges[i].first, end = start + ranges[i].second;
+                size_t aligned = (start + alignment - 1) / alignment * alignment;
+                if (aligned + size > end)
+                    continue;
+                offset = aligned;
+                ranges.erase(ranges.begin() + i);
+                // what is left on either side goes back, in order
+                if (aligned + size < end)
+                    ranges.insert(ranges.begin() + i, std::make_pair(aligned + size, end - aligned - size));
+                if (start < aligned)
+                    ranges.insert(ranges.begin() + i, std::make_pair(start, aligned - start));
+                return true;
+            }
+            return false;
+        }
+
+        void Free(size_t offset, size_t size)
+        {
+            if (size == 0)
+                return;
+            size_t i = 0;
+            while (i < ranges.size() && ranges[i].first < offset)
+                i++;
+            ranges.insert(ranges.begin() + i, std::make_pair(offset, size));
+            // merge with the next range, then with the previous one
+            if (i + 1 < ranges.size() && offset + size == ranges[i + 1].first)
+            {
+                ranges[i].second += ranges[i + 1].second;
+                ranges.erase(ranges.begin() + i + 1);
+            }
+            if (i > 0 && ranges[i - 1].first + ranges[i - 1].second == offset)
+            {
+                ranges[i - 1].second += ranges[i].second;
+                ranges.erase(ranges.begin() + i);
+            }
+        }
+    };
+
+    struct Page
+    {
+        unsigned int vao = 0, vbo = 0, ebo = 0;
+        FreeList vertexSpace, indexSpace;
+        // buffer and first instance attributes 5-8 currently read from
+        unsigned int instanceBuffer = 0;
+        unsigned int firstInstance = 0;
+
+        Page(size_t vertices, size_t indexBytes)
+            : vertexSpace(vertices), indexSpace(indexBytes)
+        {
+        }
+    };
+
+    static std::vector<Page> &pages()
+    {
+        static std::vector<Page> all;
+        return all;
+    }
+
+    static unsigned int &boundVertexArray()
+    {
+        static unsigned int vao = 0;
+        return vao;
+    }
+
+    static Page createPage(size_t vertices, size_t indexBytes)
+    {
+        Page page(vertices, indexBytes);
+        glGenVertexArrays(1, &page.vao);
+        glGenBuffers(1, &page.vbo);
+        glGenBuffers(1, &page.ebo);
+
+        glBindVertexArray(page.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+
+        // vertex positions, xyz quantized and w the tangent handedness
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // vertex tangent; the bitangent is cross(normal, tangent) times the handedness
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        boundVertexArray() = 0;
+        return page;
+    }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// GPU time of a stretch of GL commands, measured with a pair of GL_TIMESTAMP queries. Results come back
+// a few frames late, so the query pairs go round a small ring and are only read once the GPU has finished
+// them; that way timing never stalls the pipeline. Each Begin names a section, and the results are
+// averaged per section until it is Reset, so measurements of different code paths don't mix even while
+// their queries are still in flight. Timestamps (unlike GL_TIME_ELAPSED queries) nest, so one timer can
+// measure a part of what another is measuring; a single timer still has one section open at a time.
+class GpuTimer
+{
+public:
+    explicit GpuTimer(unsigned int sections = 1)
+        : totals(sections, 0.0), samples(sections, 0)
+    {
+        glGenQueries(RING_SIZE * 2, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(RING_SIZE * 2, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void Begin(unsigned int section = 0)
+    {
+        collect(false);
+        // the ring is full of unfinished queries: wait for the oldest rather than drop it
+        if (pending[next])
+            collect(true);
+        sectionOf[next] = section;
+        glQueryCounter(queries[next * 2], GL_TIMESTAMP);
+    }
+
+    void End()
+    {
+        glQueryCounter(queries[next * 2 + 1], GL_TIMESTAMP);
+        pending[next] = true;
+        next = (next + 1) % RING_SIZE;
+    }
+
+    // average of the finished measurements of a section since its last Reset, 0 if there are none
+    double Milliseconds(unsigned int section = 0) const
+    {
+        return samples[section] > 0 ? totals[section] / samples[section] : 0.0;
+    }
+
+    unsigned int Samples(unsigned int section = 0) const
+    {
+        return samples[section];
+    }
+
+    void Reset(unsigned int section = 0)
+    {
+        totals[section] = 0.0;
+        samples[section] = 0;
+    }
+
+private:
+    static const int RING_SIZE = 8;
+
+    // start and end timestamp of every slot
+    unsigned int queries[RING_SIZE * 2] = {};
+    unsigned int sectionOf[RING_SIZE] = {};
+    bool pending[RING_SIZE] = {};
+    int next = 0;
+    std::vector<double> totals;
+    std::vector<unsigned int> samples;
+
+    // reads finished queries oldest first (the slot Begin reuses next is the oldest); with wait,
+    // blocks until that oldest one is done
+    void collect(bool wait)
+    {
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            int slot = (next + i) % RING_SIZE;
+            if (!pending[slot])
+                continue;
+            if (!(wait && i == 0))
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break; // queries finish in order, the newer ones aren't done either
+            }
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+            pending[slot] = false;
+            totals[sectionOf[slot]] += (end - start) / 1000000.0;
+            samples[sectionOf[slot]]++;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Minimal KTX 1.1 reader/writer for 2D textures with a full set of compressed mip levels, or plain
+// uncompressed ones (https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html). Files are written in native byte order,
+// which the endianness field records. The hash of the source image goes into the key/value data
+// under "rg.sourceHash", so a cached file is only used while it still matches the image it came from.
+struct KtxImage
+{
+    // both 0 for a compressed texture, the glTexImage2D type and format of uncompressed texels otherwise
+    uint32_t glType = 0, glFormat = 0;
+    uint32_t glInternalFormat = 0;
+    uint32_t glBaseInternalFormat = 0;
+    uint32_t width = 0, height = 0;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+class KtxFile
+{
+public:
+    static bool Save(const std::string &path, const KtxImage &image, uint64_t sourceHash)
+    {
+        Header header = {};
+        memcpy(header.identifier, identifier(), 12);
+        header.endianness = 0x04030201;
+        header.glType = image.glType;
+        header.glTypeSize = 1;
+        header.glFormat = image.glFormat;
+        header.glInternalFormat = image.glInternalFormat;
+        header.glBaseInternalFormat = image.glBaseInternalFormat;
+        header.pixelWidth = image.width;
+        header.pixelHeight = image.height;
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = (uint32_t)image.levels.size();
+
+        std::string keyValue = std::string(HASH_KEY) + '\0' + hex(sourceHash) + '\0';
+        uint32_t keyValueSize = (uint32_t)keyValue.size();
+        keyValue.resize((keyValue.size() + 3) & ~(size_t)3, '\0');
+        header.bytesOfKeyValueData = 4 + (uint32_t)keyValue.size();
+
+        // written under a temporary name, so a reader never picks up half a file
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)&keyValueSize, 4);
+            out.write(keyValue.data(), keyValue.size());
+            for (const std::vector<unsigned char> &level : image.levels)
+            {
+                uint32_t imageSize = (uint32_t)level.size();
+                out.write((const char*)&imageSize, 4);
+                out.write((const char*)level.data(), level.size());
+                static const char padding[4] = {};
+                out.write(padding, (4 - level.size() % 4) % 4);
+            }
+            if (!out)
+                return false;
+        }
+        return rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+
+    // false if the file is missing, not a 2D KTX we wrote, or made from a different source
+    static bool Load(const std::string &path, uint64_t sourceHash, KtxImage &image)
+    {
+        std::ifstream in(path, std::ios::binary);
+        Header header;
+        if (!in.read((char*)&header, sizeof(header)))
+            return false;
+        if (memcmp(header.identifier, identifier(), 12) != 0 || header.endianness != 0x04030201
+            || header.numberOfFaces != 1 || header.numberOfArrayElements != 0 || header.pixelDepth != 0
+            || header.numberOfMipmapLevels == 0 || header.bytesOfKeyValueData > 4096)
+            return false;
+
+        std::string keyValue(header.bytesOfKeyValueData, '\0');
+        if (!in.read(&keyValue[0], keyValue.size()) || keyValue.find(std::string(HASH_KEY) + '\0' + hex(sourceHash) + '\0') == std::string::npos)
+            return false;
+
+        image.glType = header.glType;
+        image.glFormat = header.glFormat;
+        image.glInternalFormat = header.glInternalFormat;
+        image.glBaseInternalFormat = header.glBaseInternalFormat;
+        image.width = header.pixelWidth;
+        image.height = header.pixelHeight;
+        image.levels.resize(header.numberOfMipmapLevels);
+        for (std::vector<unsigned char> &level : image.levels)
+        {
+            uint32_t imageSize = 0;
+            if (!in.read((char*)&imageSize, 4) || imageSize > (1u << 28))
+                return false;
+            level.resize(imageSize);
+            if (!in.read((char*)level.data(), imageSize))
+                return false;
+            in.seekg((4 - imageSize % 4) % 4, std::ios::cur);
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char *HASH_KEY = "rg.sourceHash";
+
+    struct Header
+    {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    static const unsigned char *identifier()
+    {
+        static const unsigned char id[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+        return id;
+    }
+
+    static std::string hex(uint64_t value)
+    {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+        return text;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum.h>
+
+#include <cmath>
+#include <vector>
+
+// Picks a mesh's level of detail from how large it appears on screen: the bounding sphere of its world
+// box, projected with the camera's vertical field of view, as a fraction of the screen height. Level 0
+// is drawn down to thresholds[0], level 1 down to thresholds[1] and so on; a mesh with fewer levels
+// stays at its coarsest one.
+class LodSelector
+{
+public:
+    // projected sizes below which the next coarser level is used, largest first
+    std::vector<float> thresholds = {0.3f, 0.12f, 0.05f};
+    // with this off every mesh draws at full detail
+    bool enabled = true;
+
+    void SetCamera(const glm::vec3 &position, float fovY)
+    {
+        cameraPosition = position;
+        projectionScale = 1.0f / std::tan(fovY * 0.5f);
+    }
+
+    // fraction of the screen height the box's bounding sphere covers
+    float ProjectedSize(const BoundingBox &box) const
+    {
+        glm::vec4 sphere = box.Sphere();
+        float distance = glm::length(glm::vec3(sphere) - cameraPosition);
+        if (distance <= sphere.w)
+            return 1.0f;
+        return sphere.w * projectionScale / distance;
+    }
+
+    unsigned int Level(const BoundingBox &box, unsigned int levelCount) const
+    {
+        if (!enabled || levelCount <= 1 || box.IsEmpty())
+            return 0;
+        float size = ProjectedSize(box);
+        unsigned int level = 0;
+        while (level < thresholds.size() && size < thresholds[level])
+            level++;
+        return level < levelCount ? level : levelCount - 1;
+    }
+
+private:
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float projectionScale = 1.0f;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+
+#include <string>
+#include <vector>
+
+// what a texture is for; the shaders name its samplers texture_diffuseN, texture_specularN, ...
+enum TextureType
+{
+    TEXTURE_DIFFUSE,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_TYPE_COUNT
+};
+
+// one texture of a mesh
+struct Texture {
+    unsigned int id = 0;
+    TextureType type = TEXTURE_DIFFUSE;
+    // the image it was loaded from, an index into the owning Model's textureFiles
+    unsigned int file = 0;
+    // GL_TEXTURE_2D_ARRAY once Model::PackTextureArrays moved the texture into an array, id then names
+    // the array and layer is the texture's layer in it
+    GLenum target = GL_TEXTURE_2D;
+    float layer = 0.0f;
+};
+
+// The textures of a mesh, resolved once at load into a fixed table of texture units: the Nth texture
+// of a type always goes to unit Unit(type, N), whatever else the mesh has. The sampler uniforms thus
+// never change and are set once per program (BindSamplers), and drawing a mesh is a short loop of
+// binds without any string work or allocation.
+class Material
+{
+public:
+    static const unsigned int MAX_TEXTURES = 8;
+    // texture_diffuse1 and texture_diffuse2, texture_specular1 and texture_specular2, ...
+    static const unsigned int UNITS_PER_TYPE = MAX_TEXTURES / TEXTURE_TYPE_COUNT;
+
+    Material()
+    {
+    }
+
+    // textures past the units of their type are dropped, no shader samples them
+    explicit Material(const std::vector<Texture> &textures)
+    {
+        unsigned int perType[TEXTURE_TYPE_COUNT] = {};
+        for (const Texture &texture : textures)
+        {
+            if (texture.type >= TEXTURE_TYPE_COUNT || perType[texture.type] == UNITS_PER_TYPE)
+                continue;
+            units[count] = Unit(texture.type, ++perType[texture.type]);
+            this->textures[count++] = texture;
+        }
+    }
+
+    unsigned int Size() const
+    {
+        return count;
+    }
+
+    Texture &operator[](unsigned int i)
+    {
+        return textures[i];
+    }
+
+    const Texture &operator[](unsigned int i) const
+    {
+        return textures[i];
+    }
+
+    Texture *begin() { return textures; }
+    Texture *end() { return textures + count; }
+    const Texture *begin() const { return textures; }
+    const Texture *end() const { return textures + count; }
+
+    // texture unit of the ith texture
+    unsigned int UnitOf(unsigned int i) const
+    {
+        return units[i];
+    }
+
+    bool HasArrays() const
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (textures[i].target == GL_TEXTURE_2D_ARRAY)
+                return true;
+        }
+        return false;
+    }
+
+    // binds every texture to its unit, leaving some unit other than 0 active
+    void Bind() const
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(textures[i].target, textures[i].id);
+        }
+    }
+
+    // the layer of every texture, by unit, into the float[MAX_TEXTURES] uniform at location (the
+    // TEXTURE_ARRAYS variants of the model shaders call it textureLayers)
+    void SetLayers(int location) const
+    {
+        float layers[MAX_TEXTURES] = {};
+        for (unsigned int i = 0; i < count; i++)
+            layers[units[i]] = textures[i].layer;
+        glUniform1fv(location, MAX_TEXTURES, layers);
+    }
+
+    static unsigned int Unit(TextureType type, unsigned int number)
+    {
+        return (unsigned int)type * UNITS_PER_TYPE + number - 1;
+    }
+
+    // the sampler name of a type without its number, as the shaders and the mesh packs spell it
+    static const char *TypeName(TextureType type)
+    {
+        static const char *names[TEXTURE_TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+        return type < TEXTURE_TYPE_COUNT ? names[type] : "";
+    }
+
+    // TEXTURE_TYPE_COUNT for a name that is none of the types
+    static TextureType TypeFromName(const std::string &name)
+    {
+        for (unsigned int type = 0; type < TEXTURE_TYPE_COUNT; type++)
+        {
+            if (name == TypeName((TextureType)type))
+                return (TextureType)type;
+        }
+        return TEXTURE_TYPE_COUNT;
+    }
+
+    // points the samplers of a program at the fixed units; prefix is what the shader puts in front of
+    // the sampler names (the model shaders keep them in a struct, "material."). Uses the program.
+    static void BindSamplers(Shader &shader, const std::string &prefix)
+    {
+        shader.use();
+        for (unsigned int type = 0; type < TEXTURE_TYPE_COUNT; type++)
+        {
+            for (unsigned int number = 1; number <= UNITS_PER_TYPE; number++)
+                shader.setInt(prefix + TypeName((TextureType)type) + std::to_string(number), (int)Unit((TextureType)type, number));
+        }
+    }
+
+private:
+    Texture textures[MAX_TEXTURES];
+    unsigned char units[MAX_TEXTURES] = {};
+    unsigned int count = 0;
+};
+
+#endif
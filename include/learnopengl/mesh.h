@@ -7,7 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/geometry_buffer.h>
+#include <learnopengl/material.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,113 +34,340 @@ struct Vertex {
 
 
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// the uniforms the vertex shader dequantizes positions with, resolved by the caller for a program that
+// draws every mesh the same way (the shadow map passes)
+struct PositionUniforms {
+    UniformHandle<glm::vec3> offset;
+    UniformHandle<glm::vec3> scale;
+};
+
+// one level of detail: a range of the mesh's index buffer, over the same vertices as every other level
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
 };
 
 class Mesh {
 public:
-    // mesh Data
+    // most levels of detail a mesh has, the full one included
+    static const unsigned int MAX_LODS = 4;
+
+    // mesh Data; only kept from an Assimp load until the owning Model baked them (ReleaseSource)
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
-    vector<Texture>      textures;
+    Material             material;
 
-    unsigned int VAO;
-    std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    unsigned int indexCount = 0; // of the full level
+    // levels of detail, full mesh first and coarser ones after it
+    vector<MeshLod> lods;
+    // model space box around the vertices, for culling
+    BoundingBox bounds;
+    // constructor; with upload set to false no GL call is made (safe on a worker thread) and Upload() must be called later on the GL thread.
+    // indices may hold several levels of detail back to back, levelIndexCounts then gives the length of each.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true,
+         vector<unsigned int> levelIndexCounts = vector<unsigned int>())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->material = Material(textures);
+        setLods(levelIndexCounts, (unsigned int)this->indices.size());
+        computeBounds(this->vertices.data(), (unsigned int)this->vertices.size());
+        packVertices(this->vertices.data(), (unsigned int)this->vertices.size());
+        packIndices(this->indices.data(), (unsigned int)this->indices.size());
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (upload)
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // constructor for baked data (see MeshPack): the arrays are read in place from storage, which is
+    // kept alive until the upload and then dropped. vertices and indices stay empty for such a mesh.
+    // The vertices are packed right away, so only 32 bit indices are still read from storage later.
+    Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, const vector<unsigned int> &levelIndexCounts,
+         vector<Texture> textures, shared_ptr<const void> storage, bool upload = true)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        this->material = Material(textures);
+        packIndexCount = 0;
+        for (unsigned int count : levelIndexCounts)
+            packIndexCount += count;
+        setLods(levelIndexCounts, packIndexCount);
+        computeBounds(vertexData, vertexCount);
+        packVertices(vertexData, vertexCount);
+        if (!packIndices(indexData, packIndexCount))
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            storageIndices = indexData;
+            packStorage = storage;
         }
 
+        if (upload)
+            setupMesh();
+    }
 
+    // creates the GPU buffers of a mesh constructed without upload
+    void Upload()
+    {
+        if (!geometry.IsValid())
+            setupMesh();
+    }
+
+    // render the mesh, at the given level of detail or the coarsest one it has. Leaves the geometry
+    // page's VAO bound, see GeometryBuffer::Unbind.
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        bindTextures(shader);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        DrawElements(lod);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // render count copies of the mesh in one call; instanceBuffer holds one mat4 model matrix per instance,
+    // read through attributes 5-8 (see model_lighting_instanced.vs), starting at firstInstance
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count, unsigned int lod = 0, unsigned int firstInstance = 0)
+    {
+        bindTextures(shader);
+        DrawElementsInstanced(instanceBuffer, count, lod, firstInstance);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the two halves of Draw for a caller that binds the textures itself (RenderQueue): SetUniforms
+    // sets the per mesh uniforms (the samplers are fixed, see Material::BindSamplers), DrawElements
+    // only draws
+    void SetUniforms(Shader &shader)
+    {
+        // locations only change with the program, so they are looked up once per program switch
+        if (shader.ID != uniformProgram)
+            resolveUniforms(shader);
+        if (material.HasArrays())
+            material.SetLayers(textureLayersLocation);
+        positionOffsetUniform.set(bounds.min);
+        positionScaleUniform.set(positionScale());
+    }
+
+    // only the dequantization uniforms, through handles of the caller's program; for depth only draws
+    // that need no textures and shouldn't disturb the locations SetUniforms keeps
+    void SetPositionUniforms(const PositionUniforms &uniforms) const
+    {
+        uniforms.offset.set(bounds.min);
+        uniforms.scale.set(positionScale());
+    }
+
+    void DrawElements(unsigned int lod = 0)
+    {
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        GeometryBuffer::Bind(geometry.page);
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexPointer(level), geometry.baseVertex);
+        DrawnTriangles() += level.indexCount / 3;
+    }
+
+    void DrawElementsInstanced(unsigned int instanceBuffer, unsigned int count, unsigned int lod = 0, unsigned int firstInstance = 0)
+    {
+        GeometryBuffer::BindInstanced(geometry.page, instanceBuffer, firstInstance);
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexPointer(level), count, geometry.baseVertex);
+        DrawnTriangles() += (unsigned long)level.indexCount / 3 * count;
+    }
+
+    // lets go of vertices and indices once MeshPack::Save has read them; the GPU draws from the packed
+    // copy. 32 bit indices that haven't been uploaded yet go once setupMesh is done with them.
+    void ReleaseSource()
+    {
+        vector<Vertex>().swap(vertices);
+        sourceReleased = true;
+        if (indexType == GL_UNSIGNED_SHORT || geometry.IsValid())
+            vector<unsigned int>().swap(indices);
+    }
+
+    // VAO of the geometry page the mesh lives in, 0 before the upload
+    unsigned int VertexArray() const
+    {
+        return geometry.IsValid() ? GeometryBuffer::VertexArray(geometry.page) : 0;
+    }
+
+    // triangles submitted by all meshes since the caller last reset it
+    static unsigned long &DrawnTriangles()
+    {
+        static unsigned long triangles = 0;
+        return triangles;
+    }
+
+    // gives the mesh's space in the geometry buffer back; called by the owning Model once no instance uses it anymore
+    void Release()
+    {
+        GeometryBuffer::Free(geometry);
+    }
+
 private:
-    // render data
-    unsigned int VBO, EBO;
+    // render data, invalid until setupMesh
+    GeometryBuffer::Allocation geometry;
+    // GL_UNSIGNED_SHORT where the vertex count allows it
+    GLenum indexType = GL_UNSIGNED_INT;
+    // maps the quantized positions back into the bounds
+    UniformHandle<glm::vec3> positionOffsetUniform, positionScaleUniform;
+    int textureLayersLocation = -1;
+    // the program the locations above belong to
+    unsigned int uniformProgram = 0;
+
+    // what setupMesh uploads, freed once it did
+    vector<PackedVertex> packedVertices;
+    vector<uint16_t> shortIndices;
+    // 32 bit indices of a baked mesh, read in place (see the MeshPack constructor) until setupMesh
+    const unsigned int *storageIndices = nullptr;
+    unsigned int packIndexCount = 0;
+    shared_ptr<const void> packStorage;
+    // set by ReleaseSource, indices then go after the upload
+    bool sourceReleased = false;
+
+    // binds every texture of the mesh to its unit and sets the uniforms the vertex shader dequantizes
+    // the positions with
+    void bindTextures(Shader &shader)
+    {
+        SetUniforms(shader);
+        material.Bind();
+    }
+
+    void resolveUniforms(Shader &shader)
+    {
+        positionOffsetUniform = shader.getUniform<glm::vec3>("positionOffset");
+        positionScaleUniform = shader.getUniform<glm::vec3>("positionScale");
+        textureLayersLocation = shader.getLocation("textureLayers");
+        uniformProgram = shader.ID;
+    }
 
-    // initializes all the buffer objects/arrays
+    // splits totalIndices into levels of the given lengths, a single level if there are none
+    void setLods(const vector<unsigned int> &levelIndexCounts, unsigned int totalIndices)
+    {
+        lods.clear();
+        unsigned int first = 0;
+        for (unsigned int count : levelIndexCounts)
+        {
+            lods.push_back({first, count});
+            first += count;
+        }
+        if (lods.empty())
+            lods.push_back({0, totalIndices});
+        indexCount = lods[0].indexCount;
+    }
+
+    void computeBounds(const Vertex *vertexData, unsigned int vertexCount)
+    {
+        for (unsigned int i = 0; i < vertexCount; i++)
+            bounds.Extend(vertexData[i].Position);
+    }
+
+    // size of the bounds, what a quantized position of 65535 stands for
+    glm::vec3 positionScale() const
+    {
+        return bounds.IsEmpty() ? glm::vec3(0.0f) : bounds.max - bounds.min;
+    }
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+
+    // the level's first index in the page's index buffer, as the draw calls take it
+    void *indexPointer(const MeshLod &level) const
+    {
+        return (void*)(geometry.indexOffset + level.firstIndex * indexSize());
+    }
+
+    static int16_t snorm16(float value)
+    {
+        return (int16_t)std::lround(std::max(-1.0f, std::min(value, 1.0f)) * 32767.0f);
+    }
+
+    // the unit vector projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded
+    // over the upper one, so that x and y alone say where on it the vector points
+    static void encodeOctahedral(const glm::vec3 &v, int16_t encoded[2])
+    {
+        float sum = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+        float x = 0.0f, y = 0.0f;
+        if (sum > 0.0f)
+        {
+            x = v.x / sum;
+            y = v.y / sum;
+            if (v.z < 0.0f)
+            {
+                float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = foldedX;
+                y = foldedY;
+            }
+        }
+        encoded[0] = snorm16(x);
+        encoded[1] = snorm16(y);
+    }
+
+    void packVertices(const Vertex *vertexData, unsigned int vertexCount)
+    {
+        glm::vec3 scale = positionScale();
+        glm::vec3 inverseScale(scale.x > 0.0f ? 65535.0f / scale.x : 0.0f,
+                               scale.y > 0.0f ? 65535.0f / scale.y : 0.0f,
+                               scale.z > 0.0f ? 65535.0f / scale.z : 0.0f);
+        packedVertices.resize(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            const Vertex &vertex = vertexData[i];
+            PackedVertex &packed = packedVertices[i];
+            glm::vec3 position = (vertex.Position - bounds.min) * inverseScale;
+            for (int axis = 0; axis < 3; axis++)
+                packed.Position[axis] = (uint16_t)std::lround(std::max(0.0f, std::min(position[axis], 65535.0f)));
+            // the bitangent is rebuilt from the normal and tangent, only its side is kept
+            bool rightHanded = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+            packed.Position[3] = rightHanded ? 65535 : 0;
+            encodeOctahedral(vertex.Normal, packed.Normal);
+            encodeOctahedral(vertex.Tangent, packed.Tangent);
+            unsigned int texCoords = glm::packHalf2x16(vertex.TexCoords);
+            packed.TexCoords[0] = (uint16_t)(texCoords & 0xFFFF);
+            packed.TexCoords[1] = (uint16_t)(texCoords >> 16);
+        }
+    }
+
+    // 16 bit copy of the indices if every vertex can be addressed with them; false if not
+    bool packIndices(const unsigned int *indexData, unsigned int count)
+    {
+        if (packedVertices.size() > 65536)
+        {
+            indexType = GL_UNSIGNED_INT;
+            return false;
+        }
+        indexType = GL_UNSIGNED_SHORT;
+        shortIndices.assign(indexData, indexData + count);
+        return true;
+    }
+
+    // copies the packed arrays into the geometry buffer
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        const void *indexData;
+        size_t indexBytes;
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            indexData = shortIndices.data();
+            indexBytes = shortIndices.size() * sizeof(uint16_t);
+        }
+        else if (storageIndices)
+        {
+            indexData = storageIndices;
+            indexBytes = packIndexCount * sizeof(unsigned int);
+        }
+        else
+        {
+            indexData = indices.data();
+            indexBytes = indices.size() * sizeof(unsigned int);
+        }
+        geometry = GeometryBuffer::Allocate(packedVertices.data(), (unsigned int)packedVertices.size(), indexData, indexBytes);
+
+        // the GPU has its copy now, let go of the packed arrays and the mapped pack
+        vector<PackedVertex>().swap(packedVertices);
+        vector<uint16_t>().swap(shortIndices);
+        storageIndices = nullptr;
+        packStorage.reset();
+        if (sourceReleased)
+            vector<unsigned int>().swap(indices);
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,345 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+// Reorders a mesh for the GPU at import, once its levels of detail are built:
+//   - the triangles of every level for the post-transform vertex cache, with Forsyth's linear-speed
+//     algorithm: the next triangle is the one whose vertices score highest, and a vertex scores higher
+//     the more recently it was used and the fewer triangles it has left,
+//   - then runs of those triangles for overdraw (Sander et al.): the order is cut into clusters where
+//     the cache starts over anyway or where a cut costs little, and the clusters facing away from the
+//     mesh center, which tend to hide the rest, are moved to the front,
+//   - and last the vertices, into the order the indices first use them, for the vertex fetch.
+// Only the order changes, the same triangles are drawn.
+class MeshOptimizer
+{
+public:
+    // behaviour of an index list in a simulated FIFO post-transform cache; stats of several lists add up
+    struct CacheStats
+    {
+        unsigned long triangles = 0;
+        unsigned long vertices = 0;    // distinct vertices referenced
+        unsigned long transformed = 0; // cache misses, each one a vertex shader run
+
+        // average cache miss ratio, vertex shader runs per triangle: 3 at worst, around 0.5 on a regular grid
+        float Acmr() const
+        {
+            return triangles ? (float)transformed / triangles : 0.0f;
+        }
+
+        // average transformed vertex ratio, vertex shader runs per vertex: 1 at best
+        float Atvr() const
+        {
+            return vertices ? (float)transformed / vertices : 0.0f;
+        }
+
+        void Add(const CacheStats &other)
+        {
+            triangles += other.triangles;
+            vertices += other.vertices;
+            transformed += other.transformed;
+        }
+    };
+
+    // size of the simulated FIFO cache in AnalyzeVertexCache and OptimizeOverdraw
+    static const unsigned int FIFO_CACHE_SIZE = 16;
+
+    static CacheStats AnalyzeVertexCache(const unsigned int *indices, size_t indexCount, unsigned int vertexCount)
+    {
+        CacheStats stats;
+        FifoCache cache(vertexCount);
+        std::vector<unsigned char> referenced(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            if (!cache.Access(indices[i]))
+                stats.transformed++;
+            if (!referenced[indices[i]])
+            {
+                referenced[indices[i]] = 1;
+                stats.vertices++;
+            }
+        }
+        stats.triangles = indexCount / 3;
+        return stats;
+    }
+
+    // all three passes; every level of levelIndexCounts (as in Mesh) is reordered on its own range of
+    // indices and the vertices follow the order of all of them, the full level first
+    static void Optimize(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                         const std::vector<unsigned int> &levelIndexCounts)
+    {
+        unsigned int vertexCount = (unsigned int)vertices.size();
+        size_t first = 0;
+        for (unsigned int count : levelIndexCounts)
+        {
+            OptimizeVertexCache(indices.data() + first, count, vertexCount);
+            OptimizeOverdraw(indices.data() + first, count, vertices.data(), vertexCount);
+            first += count;
+        }
+        OptimizeVertexFetch(vertices, indices);
+    }
+
+    static void OptimizeVertexCache(unsigned int *indices, size_t indexCount, unsigned int vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        // triangles around every vertex; the first remaining[v] entries are the ones not emitted yet
+        std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < indexCount; i++)
+            remaining[indices[i]]++;
+        for (unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + remaining[v];
+        std::vector<unsigned int> adjacency(indexCount), filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++)
+            adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> score(vertexCount);
+        for (unsigned int v = 0; v < vertexCount; v++)
+            score[v] = vertexScore(-1, remaining[v]);
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        int best = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+            if (triangleScore[t] > triangleScore[best])
+                best = (int)t;
+        }
+
+        std::vector<unsigned int> output;
+        output.reserve(indexCount);
+        // LRU cache, most recent first, with room for the three vertices pushed in by a triangle
+        std::vector<unsigned int> cache, next;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        next.reserve(FORSYTH_CACHE_SIZE + 3);
+        size_t scan = 0;
+        while (output.size() < triangleCount * 3)
+        {
+            // dead end, nothing in the cache has triangles left: go on with the first one not emitted
+            if (best < 0)
+            {
+                while (emitted[scan])
+                    scan++;
+                best = (int)scan;
+            }
+            emitted[best] = 1;
+            const unsigned int *triangle = indices + 3 * best;
+            next.assign(triangle, triangle + 3);
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int v = triangle[corner];
+                output.push_back(v);
+                unsigned int *around = &adjacency[offsets[v]];
+                unsigned int *found = std::find(around, around + remaining[v], (unsigned int)best);
+                std::swap(*found, around[remaining[v] - 1]);
+                remaining[v]--;
+            }
+            for (unsigned int v : cache)
+            {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    next.push_back(v);
+            }
+
+            // new cache positions and scores; whatever fell out of the cache scores like any vertex outside it
+            for (size_t i = 0; i < next.size(); i++)
+            {
+                unsigned int v = next[i];
+                cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+                score[v] = vertexScore(cachePosition[v], remaining[v]);
+            }
+            best = -1;
+            float bestScore = 0.0f;
+            for (unsigned int v : next)
+            {
+                for (unsigned int k = 0; k < remaining[v]; k++)
+                {
+                    unsigned int t = adjacency[offsets[v] + k];
+                    triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int)t;
+                    }
+                }
+            }
+            if (next.size() > FORSYTH_CACHE_SIZE)
+                next.resize(FORSYTH_CACHE_SIZE);
+            cache.swap(next);
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // expects triangles already in vertex cache order; threshold is how much worse than that order's
+    // the cache miss ratio of a cluster may get
+    static void OptimizeOverdraw(unsigned int *indices, size_t indexCount, const Vertex *vertices,
+                                 unsigned int vertexCount, float threshold = 1.05f)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        // hard boundaries, where all three vertices of a triangle miss and the order starts over anyway
+        FifoCache cache(vertexCount);
+        std::vector<unsigned int> misses(triangleCount);
+        std::vector<size_t> hard;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            misses[t] = cache.Triangle(indices + 3 * t);
+            if (t == 0 || misses[t] == 3)
+                hard.push_back(t);
+        }
+        hard.push_back(triangleCount);
+
+        // soft boundaries inside every hard cluster, where the miss ratio since the last cut is back
+        // within threshold of the cluster's own and a new start costs little
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); h++)
+        {
+            size_t start = hard[h], end = hard[h + 1];
+            unsigned long clusterMisses = 0;
+            for (size_t t = start; t < end; t++)
+                clusterMisses += misses[t];
+            float limit = threshold * clusterMisses / (end - start);
+
+            clusters.push_back(start);
+            cache.Reset();
+            size_t runStart = start;
+            unsigned long runMisses = 0;
+            for (size_t t = start; t + 1 < end; t++)
+            {
+                runMisses += cache.Triangle(indices + 3 * t);
+                if ((float)runMisses / (t + 1 - runStart) <= limit)
+                {
+                    clusters.push_back(t + 1);
+                    cache.Reset();
+                    runStart = t + 1;
+                    runMisses = 0;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        // a cluster sorts by how far its surface lies out from the mesh center along its own normal
+        glm::vec3 meshCenter(0.0f);
+        for (size_t i = 0; i < indexCount; i++)
+            meshCenter += vertices[indices[i]].Position;
+        meshCenter /= (float)(triangleCount * 3);
+        size_t clusterCount = clusters.size() - 1;
+        std::vector<float> keys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            glm::vec3 center(0.0f), normal(0.0f);
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                const glm::vec3 &a = vertices[indices[3 * t]].Position;
+                const glm::vec3 &b = vertices[indices[3 * t + 1]].Position;
+                const glm::vec3 &d = vertices[indices[3 * t + 2]].Position;
+                center += a + b + d;
+                normal += glm::cross(b - a, d - a);
+            }
+            center /= (float)(3 * (clusters[c + 1] - clusters[c]));
+            float length = glm::length(normal);
+            keys[c] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+        }
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+            return keys[a] > keys[b];
+        });
+
+        std::vector<unsigned int> output;
+        output.reserve(indexCount);
+        for (size_t c : order)
+            output.insert(output.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // vertices in order of first use by indices, which are rewritten to match; vertices no index uses
+    // are dropped
+    static void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == UINT_MAX)
+            {
+                remap[index] = (unsigned int)ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+private:
+    // Forsyth's scoring: the LRU cache it models and the weights of its terms
+    static const unsigned int FORSYTH_CACHE_SIZE = 32;
+
+    static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the vertices of the last triangle get a fixed score, so it isn't simply repeated
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        // vertices with few triangles left get done first, so they don't linger as lone triangles
+        score += 2.0f / std::sqrt((float)remainingTriangles);
+        return score;
+    }
+
+    // FIFO cache by insertion time: a vertex is in it until FIFO_CACHE_SIZE other misses came after it
+    struct FifoCache
+    {
+        std::vector<unsigned long> inserted;
+        unsigned long clock = FIFO_CACHE_SIZE;
+
+        explicit FifoCache(unsigned int vertexCount)
+            : inserted(vertexCount, 0)
+        {
+        }
+
+        // true on a hit
+        bool Access(unsigned int v)
+        {
+            if (clock - inserted[v] < FIFO_CACHE_SIZE)
+                return true;
+            inserted[v] = ++clock;
+            return false;
+        }
+
+        unsigned int Triangle(const unsigned int *triangle)
+        {
+            unsigned int misses = 0;
+            for (int corner = 0; corner < 3; corner++)
+                misses += Access(triangle[corner]) ? 0 : 1;
+            return misses;
+        }
+
+        void Reset()
+        {
+            clock += FIFO_CACHE_SIZE;
+        }
+    };
+};
+
+#endif
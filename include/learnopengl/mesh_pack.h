@@ -0,0 +1,322 @@
+#ifndef MESH_PACK_H
+#define MESH_PACK_H
+
+#include <learnopengl/mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// read-only memory mapping of a whole file, unmapped when the last reference goes away
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void *mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                bytes = (const unsigned char*)mapped;
+                size = (size_t)info.st_size;
+            }
+        }
+        close(fd); // the mapping stays valid without the descriptor
+    }
+
+    ~MappedFile()
+    {
+        if (bytes)
+            munmap((void*)bytes, size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char *Data() const { return bytes; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char *bytes = nullptr;
+    size_t size = 0;
+};
+
+// Baked form of what Model::loadModel gets out of Assimp: per mesh the final Vertex and index arrays
+// (the index array holds all levels of detail back to back) plus its texture bindings (type and file
+// name relative to the model directory). It is written next to the source as <file>.meshpack and
+// tagged with a hash of the .obj and its .mtl files, so editing the source rebakes it on the next
+// run. The file uses the native byte order and Vertex layout.
+//
+// layout: Header | MeshRecord[meshCount] | TextureRecord[textureCount] | string table | vertex and index arrays
+class MeshPack
+{
+public:
+    // a texture of a baked mesh, before the model acquires it
+    struct TextureView
+    {
+        TextureType type;
+        string path;
+    };
+
+    // one baked mesh, pointing into the mapping
+    struct MeshView
+    {
+        const Vertex *vertices;
+        unsigned int vertexCount;
+        const unsigned int *indices;
+        unsigned int indexCount; // of all levels
+        vector<unsigned int> levelIndexCounts;
+        vector<TextureView> textures;
+    };
+
+    // maps packPath and checks it against sourceHash; returns nullptr if it is missing, stale or damaged
+    static shared_ptr<MeshPack> Open(const string &packPath, uint64_t sourceHash)
+    {
+        shared_ptr<MappedFile> file = make_shared<MappedFile>(packPath);
+        if (file->Size() < sizeof(Header))
+            return nullptr;
+
+        const Header *header = (const Header*)file->Data();
+        if (header->magic != MAGIC || header->version != VERSION || header->vertexSize != sizeof(Vertex)
+            || header->sourceHash != sourceHash || header->fileSize != file->Size())
+            return nullptr;
+
+        uint64_t tablesEnd = sizeof(Header) + (uint64_t)header->meshCount * sizeof(MeshRecord)
+                             + (uint64_t)header->textureCount * sizeof(TextureRecord) + header->stringBytes;
+        if (tablesEnd > file->Size())
+            return nullptr;
+
+        shared_ptr<MeshPack> pack(new MeshPack());
+        pack->file = file;
+        const MeshRecord *meshRecords = (const MeshRecord*)(file->Data() + sizeof(Header));
+        const TextureRecord *textureRecords = (const TextureRecord*)(meshRecords + header->meshCount);
+        const char *strings = (const char*)(textureRecords + header->textureCount);
+        for (unsigned int i = 0; i < header->meshCount; i++)
+        {
+            const MeshRecord &record = meshRecords[i];
+            if (record.vertexOffset + (uint64_t)record.vertexCount * sizeof(Vertex) > file->Size()
+                || record.indexOffset + (uint64_t)record.indexCount * sizeof(unsigned int) > file->Size()
+                || record.firstTexture + record.textureCount > header->textureCount
+                || record.levelCount == 0 || record.levelCount > Mesh::MAX_LODS)
+                return nullptr;
+
+            MeshView mesh;
+            mesh.vertices = (const Vertex*)(file->Data() + record.vertexOffset);
+            mesh.vertexCount = record.vertexCount;
+            mesh.indices = (const unsigned int*)(file->Data() + record.indexOffset);
+            mesh.indexCount = record.indexCount;
+            uint64_t levelIndices = 0;
+            for (unsigned int level = 0; level < record.levelCount; level++)
+            {
+                mesh.levelIndexCounts.push_back(record.levelIndexCounts[level]);
+                levelIndices += record.levelIndexCounts[level];
+            }
+            if (levelIndices != record.indexCount)
+                return nullptr;
+            for (unsigned int t = 0; t < record.textureCount; t++)
+            {
+                const TextureRecord &texture = textureRecords[record.firstTexture + t];
+                if ((uint64_t)texture.typeOffset + texture.typeLength > header->stringBytes
+                    || (uint64_t)texture.pathOffset + texture.pathLength > header->stringBytes)
+                    return nullptr;
+                TextureView binding;
+                binding.type = Material::TypeFromName(string(strings + texture.typeOffset, texture.typeLength));
+                binding.path.assign(strings + texture.pathOffset, texture.pathLength);
+                if (binding.type == TEXTURE_TYPE_COUNT)
+                    return nullptr;
+                mesh.textures.push_back(binding);
+            }
+            pack->meshes.push_back(mesh);
+        }
+        return pack;
+    }
+
+    // writes the processed meshes of a model; goes through a temporary file so a concurrent or
+    // interrupted run never sees half a pack
+    static bool Save(const string &packPath, uint64_t sourceHash, const vector<Mesh> &meshes, const vector<string> &textureFiles)
+    {
+        Header header = {};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.sourceHash = sourceHash;
+        header.meshCount = (uint32_t)meshes.size();
+
+        vector<MeshRecord> meshRecords(meshes.size());
+        vector<TextureRecord> textureRecords;
+        string strings;
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            meshRecords[i].firstTexture = (uint32_t)textureRecords.size();
+            meshRecords[i].textureCount = meshes[i].material.Size();
+            for (const Texture &texture : meshes[i].material)
+            {
+                string type = Material::TypeName(texture.type);
+                const string &path = textureFiles[texture.file];
+                TextureRecord record;
+                record.typeOffset = (uint32_t)strings.size();
+                record.typeLength = (uint32_t)type.size();
+                strings += type;
+                record.pathOffset = (uint32_t)strings.size();
+                record.pathLength = (uint32_t)path.size();
+                strings += path;
+                textureRecords.push_back(record);
+            }
+        }
+        header.textureCount = (uint32_t)textureRecords.size();
+        header.stringBytes = (uint32_t)strings.size();
+
+        // arrays start 16-byte aligned after the tables
+        uint64_t offset = sizeof(Header) + meshRecords.size() * sizeof(MeshRecord)
+                          + textureRecords.size() * sizeof(TextureRecord) + strings.size();
+        offset = align(offset);
+        uint64_t dataStart = offset;
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            meshRecords[i].vertexOffset = offset;
+            meshRecords[i].vertexCount = (uint32_t)meshes[i].vertices.size();
+            offset = align(offset + meshes[i].vertices.size() * sizeof(Vertex));
+            meshRecords[i].indexOffset = offset;
+            meshRecords[i].indexCount = (uint32_t)meshes[i].indices.size();
+            meshRecords[i].levelCount = (uint32_t)std::min<size_t>(meshes[i].lods.size(), Mesh::MAX_LODS);
+            for (uint32_t level = 0; level < meshRecords[i].levelCount; level++)
+                meshRecords[i].levelIndexCounts[level] = meshes[i].lods[level].indexCount;
+            offset = align(offset + meshes[i].indices.size() * sizeof(unsigned int));
+        }
+        header.fileSize = offset;
+
+        string tempPath = packPath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+            out.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+            out.write(strings.data(), strings.size());
+            pad(out, dataStart);
+            for (const Mesh &mesh : meshes)
+            {
+                out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+                pad(out, align((uint64_t)out.tellp()));
+                out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+                pad(out, align((uint64_t)out.tellp()));
+            }
+            if (!out)
+                return false;
+        }
+        return rename(tempPath.c_str(), packPath.c_str()) == 0;
+    }
+
+    // FNV-1a over the source .obj and every .mtl it references; 0 if the source can't be read
+    static uint64_t HashSource(const string &objPath)
+    {
+        MappedFile obj(objPath);
+        if (!obj.Data())
+            return 0;
+        uint64_t hash = hashBytes(obj.Data(), obj.Size(), 14695981039346656037ull ^ VERSION);
+
+        string directory = objPath.substr(0, objPath.find_last_of('/'));
+        const char *text = (const char*)obj.Data();
+        const char *end = text + obj.Size();
+        static const char keyword[] = "mtllib ";
+        for (const char *line = text; line < end; )
+        {
+            const char *lineEnd = std::find(line, end, '\n');
+            if ((size_t)(lineEnd - line) > sizeof(keyword) - 1 && memcmp(line, keyword, sizeof(keyword) - 1) == 0)
+            {
+                string name(line + sizeof(keyword) - 1, lineEnd);
+                name.erase(name.find_last_not_of(" \t\r") + 1);
+                MappedFile mtl(directory + '/' + name);
+                if (mtl.Data())
+                    hash = hashBytes(mtl.Data(), mtl.Size(), hash);
+            }
+            line = lineEnd + 1;
+        }
+        return hash;
+    }
+
+    // views into the mapping, valid as long as this pack is alive
+    vector<MeshView> meshes;
+
+private:
+    static const uint32_t MAGIC = 0x4B50534Du; // "MSPK"
+    static const uint32_t VERSION = 3;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        uint32_t textureCount;
+        uint32_t stringBytes;
+        uint64_t sourceHash;
+        uint64_t fileSize;
+    };
+
+    struct MeshRecord
+    {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        uint32_t levelCount;
+        uint32_t levelIndexCounts[Mesh::MAX_LODS];
+    };
+
+    struct TextureRecord
+    {
+        uint32_t typeOffset;
+        uint32_t typeLength;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+    };
+
+    shared_ptr<MappedFile> file;
+
+    MeshPack() {}
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    static void pad(ofstream &out, uint64_t offset)
+    {
+        static const char zeros[16] = {};
+        uint64_t position = (uint64_t)out.tellp();
+        if (offset > position)
+            out.write(zeros, offset - position);
+    }
+
+    static uint64_t hashBytes(const unsigned char *bytes, size_t size, uint64_t hash)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+#endif
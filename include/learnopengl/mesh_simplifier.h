@@ -0,0 +1,393 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert) for building levels of detail at import.
+// It does half-edge collapses: a vertex is merged into one of its neighbours and every coarser level
+// is a new index list over the unchanged vertex array, so all levels of a mesh share one vertex buffer.
+//
+// Vertices are welded by position first, so the split vertices along a UV or normal seam move together.
+// A collapse is rejected if it would flip a triangle, pull a vertex off an open border, or tear a seam
+// (a vertex with several attribute variants only collapses along an edge all of them share).
+class MeshSimplifier
+{
+public:
+    // index lists of progressively coarser versions of the triangles, one per entry of ratios (each a
+    // fraction of the original triangle count, in decreasing order). Stops early, with fewer lists,
+    // when the mesh can't be reduced any further.
+    static std::vector<std::vector<unsigned int>> BuildLevels(const Vertex *vertices, unsigned int vertexCount,
+                                                              const std::vector<unsigned int> &indices,
+                                                              const std::vector<float> &ratios)
+    {
+        MeshSimplifier simplifier(vertices, vertexCount, indices);
+        std::vector<std::vector<unsigned int>> levels;
+        size_t previousTriangles = indices.size() / 3;
+        for (float ratio : ratios)
+        {
+            size_t target = (size_t)(ratio * (indices.size() / 3));
+            simplifier.collapseTo(target);
+            // a level only pays for its index buffer if it is clearly coarser than the one before
+            if (simplifier.liveTriangles > previousTriangles * MIN_LEVEL_REDUCTION)
+                break;
+            levels.push_back(simplifier.currentIndices());
+            previousTriangles = simplifier.liveTriangles;
+        }
+        return levels;
+    }
+
+private:
+    // next level has to have at most this fraction of the previous level's triangles
+    static constexpr double MIN_LEVEL_REDUCTION = 0.85;
+    // border edges are held in place by planes through them, weighted this much over the face planes
+    static constexpr double BORDER_WEIGHT = 100.0;
+
+    // symmetric 4x4 matrix of the plane equations' outer products, upper triangle only
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        void AddPlane(const glm::dvec3 &normal, double d, double weight)
+        {
+            double a = normal.x, b = normal.y, c = normal.z;
+            a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+            b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+            c2 += weight * c * c; cd += weight * c * d;
+            d2 += weight * d * d;
+        }
+
+        void Add(const Quadric &o)
+        {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2;
+            bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+        }
+
+        // sum of the squared distances of p to all planes
+        double Error(const glm::dvec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z + d2;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromVersion, toVersion;
+        bool reversed; // the cheaper direction of the edge was rejected, this is the other one
+
+        bool operator>(const Collapse &o) const
+        {
+            return cost > o.cost;
+        }
+    };
+
+    std::vector<glm::dvec3> positions;           // per welded vertex
+    std::vector<unsigned int> weldOf;            // welded vertex of each original vertex
+    std::vector<Quadric> quadrics;               // per welded vertex
+    std::vector<unsigned int> versions;          // bumped whenever a welded vertex changes
+    std::vector<bool> removed;                   // welded vertex collapsed away
+    std::vector<unsigned int> corners;           // original vertex per triangle corner
+    std::vector<bool> deadTriangles;
+    std::vector<std::vector<unsigned int>> trianglesOf; // per welded vertex, may hold dead triangles
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    std::vector<unsigned int> neighbours;
+    size_t liveTriangles = 0;
+
+    MeshSimplifier(const Vertex *vertices, unsigned int vertexCount, const std::vector<unsigned int> &indices)
+    {
+        // weld by exact position
+        std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+        weldOf.resize(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            const glm::vec3 &p = vertices[i].Position;
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            uint64_t key = (uint64_t)bits[0] * 73856093u ^ (uint64_t)bits[1] * 19349663u ^ (uint64_t)bits[2] * 83492791u;
+            std::vector<unsigned int> &bucket = buckets[key];
+            unsigned int weld = (unsigned int)positions.size();
+            for (unsigned int candidate : bucket)
+            {
+                if (positions[candidate] == glm::dvec3(p))
+                {
+                    weld = candidate;
+                    break;
+                }
+            }
+            if (weld == positions.size())
+            {
+                positions.push_back(glm::dvec3(p));
+                bucket.push_back(weld);
+            }
+            weldOf[i] = weld;
+        }
+        quadrics.resize(positions.size());
+        versions.assign(positions.size(), 0);
+        removed.assign(positions.size(), false);
+        trianglesOf.resize(positions.size());
+
+        // triangles that are already degenerate once welded are left out
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = weldOf[indices[i]], b = weldOf[indices[i + 1]], c = weldOf[indices[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            unsigned int triangle = (unsigned int)(corners.size() / 3);
+            corners.insert(corners.end(), {indices[i], indices[i + 1], indices[i + 2]});
+            for (unsigned int v : {a, b, c})
+                trianglesOf[v].push_back(triangle);
+
+            glm::dvec3 normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+            double length = glm::length(normal);
+            if (length > 0.0)
+            {
+                normal /= length;
+                double d = -glm::dot(normal, positions[a]);
+                for (unsigned int v : {a, b, c})
+                    quadrics[v].AddPlane(normal, d, 1.0);
+            }
+        }
+        deadTriangles.assign(corners.size() / 3, false);
+        liveTriangles = corners.size() / 3;
+
+        // planes perpendicular to the faces along every open edge keep the borders in place
+        for (unsigned int t = 0; t < deadTriangles.size(); t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = weld(t, e), b = weld(t, (e + 1) % 3);
+                if (edgeTriangles(a, b) != 1)
+                    continue;
+                glm::dvec3 edge = positions[b] - positions[a];
+                glm::dvec3 faceNormal = glm::cross(positions[weld(t, 1)] - positions[weld(t, 0)],
+                                                   positions[weld(t, 2)] - positions[weld(t, 0)]);
+                glm::dvec3 normal = glm::cross(edge, faceNormal);
+                double length = glm::length(normal);
+                if (length == 0.0)
+                    continue;
+                normal /= length;
+                double d = -glm::dot(normal, positions[a]);
+                quadrics[a].AddPlane(normal, d, BORDER_WEIGHT);
+                quadrics[b].AddPlane(normal, d, BORDER_WEIGHT);
+            }
+        }
+
+        for (unsigned int v = 0; v < positions.size(); v++)
+            pushCollapses(v, true);
+    }
+
+    unsigned int weld(unsigned int triangle, int corner) const
+    {
+        return weldOf[corners[triangle * 3 + corner]];
+    }
+
+    bool hasVertex(unsigned int triangle, unsigned int v) const
+    {
+        return weld(triangle, 0) == v || weld(triangle, 1) == v || weld(triangle, 2) == v;
+    }
+
+    // live triangles sharing the edge a-b
+    int edgeTriangles(unsigned int a, unsigned int b) const
+    {
+        int count = 0;
+        for (unsigned int t : trianglesOf[a])
+        {
+            if (!deadTriangles[t] && hasVertex(t, b))
+                count++;
+        }
+        return count;
+    }
+
+    double cost(unsigned int from, unsigned int to) const
+    {
+        Quadric sum = quadrics[from];
+        sum.Add(quadrics[to]);
+        return sum.Error(positions[to]);
+    }
+
+    // queues every edge of v once, in its cheaper direction; the first time around each edge is only
+    // queued from its lower numbered vertex
+    void pushCollapses(unsigned int v, bool initial)
+    {
+        neighbours.clear();
+        for (unsigned int t : trianglesOf[v])
+        {
+            if (deadTriangles[t])
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int w = weld(t, c);
+                if (w != v && (!initial || w > v))
+                    neighbours.push_back(w);
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (unsigned int w : neighbours)
+        {
+            double toW = cost(v, w), toV = cost(w, v);
+            if (toW <= toV)
+                queue.push({toW, v, w, versions[v], versions[w], false});
+            else
+                queue.push({toV, w, v, versions[w], versions[v], false});
+        }
+    }
+
+    // the vertex of the collapse target each attribute variant of from is moved to: the corner of to in
+    // a triangle it shares with the variant. False if some variant shares no triangle with to.
+    bool mapVariants(unsigned int from, unsigned int to, std::unordered_map<unsigned int, unsigned int> &targets) const
+    {
+        for (unsigned int t : trianglesOf[from])
+        {
+            if (deadTriangles[t] || !hasVertex(t, to))
+                continue;
+            unsigned int variant = 0, target = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                if (weld(t, c) == from)
+                    variant = corners[t * 3 + c];
+                else if (weld(t, c) == to)
+                    target = corners[t * 3 + c];
+            }
+            targets[variant] = target;
+        }
+        for (unsigned int t : trianglesOf[from])
+        {
+            if (deadTriangles[t])
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                if (weld(t, c) == from && targets.find(corners[t * 3 + c]) == targets.end())
+                    return false;
+            }
+        }
+        return !targets.empty();
+    }
+
+    // whether some edge of v belongs to only one triangle: every edge shows up once per triangle in the
+    // list of v's neighbours, so a neighbour listed once means an open edge
+    bool isBorder(unsigned int v)
+    {
+        neighbours.clear();
+        for (unsigned int t : trianglesOf[v])
+        {
+            if (deadTriangles[t])
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                if (weld(t, c) != v)
+                    neighbours.push_back(weld(t, c));
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        for (size_t i = 0; i < neighbours.size(); )
+        {
+            size_t j = i;
+            while (j < neighbours.size() && neighbours[j] == neighbours[i])
+                j++;
+            if (j - i == 1)
+                return true;
+            i = j;
+        }
+        return false;
+    }
+
+    // no triangle that stays may turn over when from moves onto to
+    bool flips(unsigned int from, unsigned int to) const
+    {
+        for (unsigned int t : trianglesOf[from])
+        {
+            if (deadTriangles[t] || hasVertex(t, to))
+                continue;
+            glm::dvec3 before[3], after[3];
+            for (int c = 0; c < 3; c++)
+            {
+                before[c] = positions[weld(t, c)];
+                after[c] = weld(t, c) == from ? positions[to] : before[c];
+            }
+            glm::dvec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(oldNormal, newNormal) <= 0.0)
+                return true;
+        }
+        return false;
+    }
+
+    void collapseTo(size_t targetTriangles)
+    {
+        std::unordered_map<unsigned int, unsigned int> targets;
+        while (liveTriangles > targetTriangles && !queue.empty())
+        {
+            Collapse collapse = queue.top();
+            queue.pop();
+            unsigned int from = collapse.from, to = collapse.to;
+            if (removed[from] || removed[to] || versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion)
+                continue;
+            int shared = edgeTriangles(from, to);
+            if (shared == 0)
+                continue;
+            targets.clear();
+            // a border vertex may only slide along its border
+            if ((isBorder(from) && shared != 1) || !mapVariants(from, to, targets) || flips(from, to))
+            {
+                if (!collapse.reversed)
+                    queue.push({cost(to, from), to, from, versions[to], versions[from], true});
+                continue;
+            }
+
+            for (unsigned int t : trianglesOf[from])
+            {
+                if (deadTriangles[t])
+                    continue;
+                if (hasVertex(t, to))
+                {
+                    deadTriangles[t] = true;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int c = 0; c < 3; c++)
+                {
+                    if (weld(t, c) == from)
+                        corners[t * 3 + c] = targets[corners[t * 3 + c]];
+                }
+                trianglesOf[to].push_back(t);
+            }
+            trianglesOf[from].clear();
+            removed[from] = true;
+            quadrics[to].Add(quadrics[from]);
+            versions[to]++;
+
+            // drop the dead triangles of to and requeue its edges with the new quadric
+            std::vector<unsigned int> &list = trianglesOf[to];
+            list.erase(std::remove_if(list.begin(), list.end(), [this](unsigned int t) { return deadTriangles[t]; }), list.end());
+            pushCollapses(to, false);
+        }
+    }
+
+    std::vector<unsigned int> currentIndices() const
+    {
+        std::vector<unsigned int> result;
+        result.reserve(liveTriangles * 3);
+        for (unsigned int t = 0; t < deadTriangles.size(); t++)
+        {
+            if (!deadTriangles[t])
+                result.insert(result.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+        }
+        return result;
+    }
+};
+
+#endif
@@ -11,17 +11,31 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/frustum.h>
 #include <learnopengl/shader.h>
-
+#include <learnopengl/filesystem.h>
+#include <learnopengl/mesh_pack.h>
+#include <learnopengl/mesh_simplifier.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/lod_selector.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/texture_array.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool normalMap = false);
 
 
 
@@ -29,33 +43,262 @@ class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every texture reference this model holds in TextureCache, released when the model goes away
+    vector<string>  textureFiles;       // the images the meshes' textures come from, relative to directory (Texture::file)
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // model space box around all meshes, set once the meshes are loaded
+    BoundingBox bounds;
+
+    // constructor, expects a filepath to a 3D model. A streamed model loads nothing here: see
+    // ModelCache::AcquireAsync, which imports it on a worker thread and uploads it a bit per frame.
+    Model(string const &path, bool gamma = false, bool streamed = false)
+        : gammaCorrection(gamma), path(path), streamed(streamed), imported(false), ready(false),
+          requested(TextureCache::Clock::now())
+    {
+        if (!streamed)
+        {
+            loadModel(path);
+            ready = true;
+        }
+    }
+
+    // a Model owns GPU objects, so it is shared through ModelCache instead of being copied
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    ~Model()
     {
-        loadModel(path);
+        for (Mesh& mesh : meshes)
+            mesh.Release();
+        for (Texture& texture : textures_loaded)
+            TextureCache::Release(texture.id);
+        textureArrays.Release();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // draws the model, and thus all its meshes. A streamed model that isn't ready yet draws nothing.
+    // meshVisible, if given, holds a flag per mesh and the meshes flagged 0 are skipped; meshLod, if
+    // given, the level of detail of each mesh.
+    void Draw(Shader &shader, const vector<unsigned char> *meshVisible = nullptr, const vector<unsigned char> *meshLod = nullptr)
     {
+        if (!ready)
+            return;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (!meshVisible || (*meshVisible)[i])
+                meshes[i].Draw(shader, meshLod ? (*meshLod)[i] : 0);
+        }
+    }
+
+    // draws count copies of the model, one instanced draw call per mesh; instanceBuffer holds a mat4 per
+    // copy and the copies drawn start at firstInstance
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count, unsigned int lod = 0, unsigned int firstInstance = 0)
+    {
+        if (!ready || count == 0)
+            return;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawInstanced(shader, instanceBuffer, count, lod, firstInstance);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+    // draws only the depth of every mesh, without textures; positions are dequantized through uniforms
+    // of the caller's program (a shadow map pass, see shadow_maps.h)
+    void DrawDepth(const PositionUniforms &uniforms, unsigned int lod = 0)
+    {
+        if (!ready)
+            return;
+        for (Mesh &mesh : meshes)
+        {
+            mesh.SetPositionUniforms(uniforms);
+            mesh.DrawElements(lod);
+        }
+    }
+
+    void DrawDepthInstanced(const PositionUniforms &uniforms, unsigned int instanceBuffer, unsigned int count, unsigned int lod = 0)
+    {
+        if (!ready || count == 0)
+            return;
+        for (Mesh &mesh : meshes)
+        {
+            mesh.SetPositionUniforms(uniforms);
+            mesh.DrawElementsInstanced(instanceBuffer, count, lod);
         }
     }
+
+    // moves the textures of all meshes into texture arrays (see texture_array.h) as soon as they are
+    // resident; the meshes then need a shader built with TEXTURE_ARRAYS. A model loaded synchronously
+    // inside a TextureCache batch has to call this after EndBatch.
+    void PackTextureArrays()
+    {
+        packTextures = true;
+        if (ready)
+            packTextureArrays();
+    }
+
+    bool IsReady() const
+    {
+        return ready;
+    }
+
+    const string &Path() const
+    {
+        return path;
+    }
+
+    // milliseconds between the load request and the model becoming ready
+    double LoadMilliseconds() const
+    {
+        return std::chrono::duration<double, std::milli>(readyAt - requested).count();
+    }
+
+    // worker thread: Assimp import and conversion into Vertex/index arrays, no GL calls
+    void Import()
+    {
+        loadModel(path);
+        imported = true;
+    }
+
+    // GL thread: uploads the meshes of a finished import and requests its textures until the deadline
+    // passes (at least one mesh per call). Returns true once the model and all of its textures are resident.
+    bool Upload(TextureCache::Clock::time_point deadline)
+    {
+        if (ready)
+            return true;
+        if (!imported)
+            return false;
+
+        if (!texturesRequested)
+        {
+            // one cache reference per mesh texture, exactly like the synchronous path
+            vector<bool> streamedOnce(textureFiles.size(), false);
+            for (Mesh& mesh : meshes)
+            {
+                for (Texture& texture : mesh.material)
+                {
+                    const string &path = textureFiles[texture.file];
+                    PendingTexture &file = pendingTextures[path];
+                    bool normalMap = texture.type == TEXTURE_NORMAL;
+                    if (!streamedOnce[texture.file])
+                        texture.id = TextureCache::AcquireStreamed(directory + '/' + path, false, file.bytes, file.contentHash, normalMap);
+                    else
+                        texture.id = TextureFromFile(path.c_str(), directory, false, normalMap);
+                    streamedOnce[texture.file] = true;
+                    textures_loaded.push_back(texture);
+                }
+            }
+            pendingTextures.clear();
+            texturesRequested = true;
+        }
+
+        while (uploadedMeshes < meshes.size())
+        {
+            meshes[uploadedMeshes++].Upload();
+            if (TextureCache::Clock::now() >= deadline)
+                return false;
+        }
+        for (Texture& texture : textures_loaded)
+        {
+            if (!TextureCache::IsResident(texture.id))
+                return false;
+        }
+
+        if (packTextures)
+            packTextureArrays();
+        readyAt = TextureCache::Clock::now();
+        ready = true;
+        return true;
+    }
 private:
+    // a texture file read and hashed by the import worker, handed to TextureCache in Upload
+    struct PendingTexture
+    {
+        vector<unsigned char> bytes;
+        uint64_t contentHash = 0;
+    };
+
+    // triangle counts of the coarser levels of detail, relative to the full mesh; smaller meshes get none
+    static const vector<float> &lodTriangleRatios()
+    {
+        static const vector<float> ratios = {0.35f, 0.12f, 0.04f};
+        return ratios;
+    }
+    static const unsigned int LOD_MIN_TRIANGLES = 256;
+
+    string path;
+    bool streamed;
+    std::atomic<bool> imported;
+    bool ready;
+    bool texturesRequested = false;
+    bool packTextures = false;
+    unsigned int uploadedMeshes = 0;
+    TextureArrays textureArrays;
+    // vertex cache behaviour of the full levels, before and after MeshOptimizer, summed over the meshes of an import
+    MeshOptimizer::CacheStats cacheBefore, cacheAfter;
+    map<string, PendingTexture> pendingTextures;
+    TextureCache::Clock::time_point requested, readyAt;
+
+    // points every mesh texture at its layer of the texture arrays and gives the 2D textures back to the cache
+    void packTextureArrays()
+    {
+        vector<unsigned int> sources;
+        for (Texture &texture : textures_loaded)
+        {
+            if (!TextureCache::IsResident(texture.id))
+                return;
+            sources.push_back(texture.id);
+        }
+        if (!textureArrays.Pack(sources))
+            return;
+        for (Mesh &mesh : meshes)
+        {
+            for (Texture &texture : mesh.material)
+            {
+                TextureArrays::Layer layer;
+                if (!textureArrays.Find(texture.id, layer))
+                    continue;
+                texture.id = layer.array;
+                texture.target = GL_TEXTURE_2D_ARRAY;
+                texture.layer = (float)layer.layer;
+            }
+        }
+        for (Texture &texture : textures_loaded)
+        {
+            TextureCache::Release(texture.id);
+            TextureCache::EvictIfUnused(texture.id);
+        }
+        textures_loaded.clear();
+        cout << "MESH:: " << path << ": " << textureArrays.PackedTextures() << " textures packed into "
+             << textureArrays.Count() << " texture arrays" << endl;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // The processed result is baked into <path>.meshpack, so the next run skips Assimp, tangent generation,
+    // simplification and optimization as long as the source is unchanged; it still packs the vertices
+    // of the memory-mapped pack into the 16 bit GPU format on every load (see Mesh).
+    // Once baked, the meshes drop their full size vertices and indices.
     void loadModel(string const &path)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        string packPath = path + ".meshpack";
+        uint64_t sourceHash = MeshPack::HashSource(path);
+        if (sourceHash != 0)
+        {
+            if (shared_ptr<MeshPack> pack = MeshPack::Open(packPath, sourceHash))
+            {
+                for (MeshPack::MeshView &view : pack->meshes)
+                {
+                    vector<Texture> textures;
+                    for (MeshPack::TextureView &binding : view.textures)
+                        textures.push_back(loadTexture(binding.path, binding.type));
+                    meshes.push_back(Mesh(view.vertices, view.vertexCount, view.indices, view.levelIndexCounts, textures, pack, !streamed));
+                }
+                computeBounds();
+                return;
+            }
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -65,11 +308,23 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        computeBounds();
+        cout << "MESH:: " << path << ": " << cacheAfter.triangles << " triangles, ACMR " << cacheBefore.Acmr()
+             << " -> " << cacheAfter.Acmr() << ", ATVR " << cacheBefore.Atvr() << " -> " << cacheAfter.Atvr() << endl;
+
+        if (sourceHash != 0 && !MeshPack::Save(packPath, sourceHash, meshes, textureFiles))
+            cout << "ERROR::MESHPACK:: could not write " << packPath << endl;
+        for (Mesh &mesh : meshes)
+            mesh.ReleaseSource();
+    }
+
+    void computeBounds()
+    {
+        for (Mesh &mesh : meshes)
+            bounds.Extend(mesh.bounds);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -164,96 +419,478 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // coarser levels of detail by edge collapse, their index lists go behind the full one
+        vector<unsigned int> levelIndexCounts(1, (unsigned int)indices.size());
+        if (indices.size() / 3 >= LOD_MIN_TRIANGLES)
+        {
+            vector<vector<unsigned int>> levels = MeshSimplifier::BuildLevels(vertices.data(), (unsigned int)vertices.size(), indices, lodTriangleRatios());
+            for (const vector<unsigned int> &level : levels)
+            {
+                levelIndexCounts.push_back((unsigned int)level.size());
+                indices.insert(indices.end(), level.begin(), level.end());
+            }
+        }
+
+        // triangle and vertex order for the GPU caches
+        cacheBefore.Add(MeshOptimizer::AnalyzeVertexCache(indices.data(), levelIndexCounts[0], (unsigned int)vertices.size()));
+        MeshOptimizer::Optimize(vertices, indices, levelIndexCounts);
+        cacheAfter.Add(MeshOptimizer::AnalyzeVertexCache(indices.data(), levelIndexCounts[0], (unsigned int)vertices.size()));
+
+        // return a mesh object created from the extracted mesh data; a streamed model uploads it later on the GL thread
+        return Mesh(vertices, indices, textures, !streamed, levelIndexCounts);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // loads all material textures of a given type. Deduplication happens in TextureCache, so a texture
+    // shared between meshes, models or even directories is only decoded and uploaded once.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(loadTexture(str.C_Str(), textureType));
+        }
+        return textures;
+    }
+
+    // acquires one texture reference of a mesh, file is relative to the model directory
+    Texture loadTexture(const string &file, TextureType type)
+    {
+        Texture texture;
+        texture.type = type;
+        texture.file = fileIndex(file);
+        if (streamed)
+        {
+            // worker thread: only read and hash the file, TextureCache is touched in Upload
+            texture.id = 0;
+            if (pendingTextures.find(file) == pendingTextures.end())
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
+                PendingTexture &pending = pendingTextures[file];
+                TextureCache::ReadFile(this->directory + '/' + file, pending.bytes);
+                pending.contentHash = TextureCache::HashContents(pending.bytes, false, type == TEXTURE_NORMAL);
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        }
+        else
+            texture.id = TextureFromFile(file.c_str(), this->directory, false, type == TEXTURE_NORMAL);
+        if (!streamed)
+            textures_loaded.push_back(texture);  // one reference per acquisition, see ~Model
+        return texture;
+    }
+
+    // index of file in textureFiles, added if it isn't there yet
+    unsigned int fileIndex(const string &file)
+    {
+        auto it = std::find(textureFiles.begin(), textureFiles.end(), file);
+        if (it != textureFiles.end())
+            return (unsigned int)(it - textureFiles.begin());
+        textureFiles.push_back(file);
+        return (unsigned int)textureFiles.size() - 1;
+    }
+};
+
+
+// keeps one loaded Model per file, so every instance of e.g. road.obj shares a single Assimp import,
+// one set of vertex/index buffers and one set of textures. Entries are reference counted through
+// shared_ptr: a model is freed as soon as the last instance holding it goes away.
+class ModelCache
+{
+public:
+    static shared_ptr<Model> Acquire(string const &path, bool gamma = false)
+    {
+        string key = FileSystem::getCanonicalPath(path) + (gamma ? "#gamma" : "");
+        map<string, weak_ptr<Model>> &models = entries();
+
+        auto it = models.find(key);
+        if (it != models.end())
+        {
+            if (shared_ptr<Model> model = it->second.lock())
+                return model;
+        }
+        shared_ptr<Model> model = make_shared<Model>(path, gamma);
+        models[key] = model;
+        return model;
+    }
+
+    // returns right away with a model that draws nothing until it is ready: Assimp import and vertex
+    // conversion run on a loader thread, Update() then uploads it within a per-frame time budget
+    static shared_ptr<Model> AcquireAsync(string const &path, bool gamma = false)
+    {
+        string key = FileSystem::getCanonicalPath(path) + (gamma ? "#gamma" : "");
+        map<string, weak_ptr<Model>> &models = entries();
+
+        auto it = models.find(key);
+        if (it != models.end())
+        {
+            if (shared_ptr<Model> model = it->second.lock())
+                return model;
+        }
+        shared_ptr<Model> model = make_shared<Model>(path, gamma, true);
+        models[key] = model;
+        streaming().push_back(model);
+        loaderPool().Submit([model]() { model->Import(); });
+        return model;
+    }
+
+    // GL thread, once per frame: spends about budgetMs uploading streamed models and their textures
+    static void Update(double budgetMs)
+    {
+        TextureCache::Clock::time_point deadline = TextureCache::Clock::now()
+                + std::chrono::duration_cast<TextureCache::Clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+        vector<shared_ptr<Model>> &loading = streaming();
+        for (size_t i = 0; i < loading.size() && TextureCache::Clock::now() < deadline; )
+        {
+            if (loading[i]->Upload(deadline))
+            {
+                cout << "STREAMING:: " << loading[i]->Path() << " ready after " << loading[i]->LoadMilliseconds() << " ms" << endl;
+                loading.erase(loading.begin() + i);
             }
+            else
+                i++;
         }
-        return textures;
+        TextureCache::Update(deadline);
+    }
+
+    // number of streamed models that aren't ready yet
+    static unsigned int Loading()
+    {
+        return (unsigned int)streaming().size();
+    }
+
+    // number of instances currently sharing the model loaded from path (0 if it isn't loaded)
+    static long UseCount(string const &path, bool gamma = false)
+    {
+        map<string, weak_ptr<Model>> &models = entries();
+        auto it = models.find(FileSystem::getCanonicalPath(path) + (gamma ? "#gamma" : ""));
+        return it == models.end() ? 0 : it->second.use_count();
+    }
+
+private:
+    static map<string, weak_ptr<Model>> &entries()
+    {
+        static map<string, weak_ptr<Model>> models;
+        return models;
+    }
+
+    static vector<shared_ptr<Model>> &streaming()
+    {
+        static vector<shared_ptr<Model>> loading;
+        return loading;
+    }
+
+    // imports get their own two threads so a long import never starves the shared decode pool
+    static ThreadPool &loaderPool()
+    {
+        static ThreadPool pool(2);
+        return pool;
+    }
+};
+
+// a placed copy of a cached model: meshes and textures are shared with every other instance
+// of the same file, the instance itself only carries its transform.
+class ModelInstance
+{
+public:
+    shared_ptr<Model> model;
+    glm::mat4 transform;
+
+    ModelInstance(string const &path, bool gamma = false)
+        : model(ModelCache::Acquire(path, gamma)), transform(1.0f)
+    {
+    }
+
+    explicit ModelInstance(shared_ptr<Model> model)
+        : model(model), transform(1.0f)
+    {
+    }
+
+    // uploads the instance transform as the 'model' uniform and draws the shared meshes
+    void Draw(Shader &shader)
+    {
+        shader.setMat4("model", transform);
+        model->Draw(shader, culled(), levels());
+    }
+
+    // same, with the 'model' uniform resolved by the caller (shader.getUniform<glm::mat4>("model"))
+    void Draw(Shader &shader, const UniformHandle<glm::mat4> &modelUniform)
+    {
+        modelUniform.set(transform);
+        model->Draw(shader, culled(), levels());
+    }
+
+    // depth only, every mesh whatever the camera culled: a shadow caster can be out of view
+    void DrawDepth(const PositionUniforms &uniforms, const UniformHandle<glm::mat4> &modelUniform, unsigned int lod = 0)
+    {
+        modelUniform.set(transform);
+        model->DrawDepth(uniforms, lod);
+    }
+
+    // queues a draw per visible mesh instead of drawing right away; the transform is read when the
+    // queue executes
+    void Submit(RenderQueue &queue, Shader &shader, const UniformHandle<glm::mat4> &modelUniform)
+    {
+        if (!model->IsReady())
+            return;
+        const vector<unsigned char> *visible = culled(), *lod = levels();
+        for (unsigned int i = 0; i < model->meshes.size(); i++)
+        {
+            if (visible && !(*visible)[i])
+                continue;
+            Mesh &mesh = model->meshes[i];
+            glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.bounds.Center(), 1.0f));
+            RenderCommand &command = queue.AddMesh(RenderQueue::OPAQUE_PASS, shader, mesh, lod ? (*lod)[i] : 0, center);
+            command.transform = &transform;
+            command.modelUniform = modelUniform;
+        }
+    }
+
+    // picks the level of detail of every mesh from its size on screen, used until the next call
+    void SelectLods(const LodSelector &selector)
+    {
+        if (!model->IsReady())
+            return;
+        meshLod.resize(model->meshes.size());
+        for (unsigned int i = 0; i < model->meshes.size(); i++)
+        {
+            const Mesh &mesh = model->meshes[i];
+            meshLod[i] = (unsigned char)selector.Level(mesh.bounds.Transformed(transform), (unsigned int)mesh.lods.size());
+        }
+    }
+
+    // hands the box of every mesh, moved by the current transform, to the culler; after its Run the
+    // draws skip the meshes outside the frustum. Call at most once per Run.
+    void Cull(FrustumCuller &culler)
+    {
+        if (!model->IsReady())
+        {
+            meshVisible.clear();
+            return;
+        }
+        meshVisible.assign(model->meshes.size(), 1);
+        for (unsigned int i = 0; i < model->meshes.size(); i++)
+            culler.Add(model->meshes[i].bounds.Transformed(transform), &meshVisible[i]);
+    }
+
+    // skips every mesh until the next Cull, for an instance known to be out of view
+    void Hide()
+    {
+        meshVisible.assign(model->IsReady() ? model->meshes.size() : 0, 0);
+    }
+
+    // shared by every instance of the model, see Model::PackTextureArrays
+    void PackTextureArrays()
+    {
+        model->PackTextureArrays();
+    }
+
+private:
+    // per mesh result of the last Cull, empty if the instance was never culled
+    vector<unsigned char> meshVisible;
+    // per mesh level of detail from the last SelectLods
+    vector<unsigned char> meshLod;
+
+    const vector<unsigned char> *levels() const
+    {
+        return model->IsReady() && meshLod.size() == model->meshes.size() ? &meshLod : nullptr;
+    }
+
+    const vector<unsigned char> *culled() const
+    {
+        // a streamed model's meshes may still be filled by the import worker until it is ready
+        return model->IsReady() && meshVisible.size() == model->meshes.size() ? &meshVisible : nullptr;
     }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// every copy of one model that shares a shader, drawn with one glDrawElementsInstanced per mesh. The
+// transforms live in a per-instance vertex buffer; call Update() after changing them. Needs a shader
+// that reads the model matrix from attributes 5-8, e.g. model_lighting_instanced.vs.
+// Culling works per copy: only the transforms of the copies inside the frustum go into the buffer.
+// So do levels of detail: the buffer holds the copies sorted by level and each level is drawn from
+// its own range of it.
+class ModelInstanceBatch
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+public:
+    shared_ptr<Model> model;
+    vector<glm::mat4> transforms;
+
+    explicit ModelInstanceBatch(shared_ptr<Model> model)
+        : model(model)
+    {
+    }
+
+    ModelInstanceBatch(const ModelInstanceBatch&) = delete;
+    ModelInstanceBatch& operator=(const ModelInstanceBatch&) = delete;
+
+    ~ModelInstanceBatch()
+    {
+        if (instanceVBO != 0)
+            glDeleteBuffers(1, &instanceVBO);
+        if (casterVBO != 0)
+            glDeleteBuffers(1, &casterVBO);
+    }
+
+    // copies the transforms of the visible copies into the instance buffer, grouped by level of detail
+    void Update()
+    {
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        if (visible.size() != transforms.size())
+            visible.assign(transforms.size(), 1);
+        if (copyLod.size() != transforms.size())
+            copyLod.assign(transforms.size(), 0);
+        visibleTransforms.clear();
+        for (unsigned int level = 0; level < Mesh::MAX_LODS; level++)
+        {
+            levelFirst[level] = (unsigned int)visibleTransforms.size();
+            for (size_t i = 0; i < transforms.size(); i++)
+            {
+                if (visible[i] && copyLod[i] == level)
+                    visibleTransforms.push_back(transforms[i]);
+            }
+            levelCount[level] = (unsigned int)visibleTransforms.size() - levelFirst[level];
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, visibleTransforms.size() * sizeof(glm::mat4), visibleTransforms.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        uploadedVisible = visible;
+        uploadedLod = copyLod;
+        uploadedTransforms = transforms;
+    }
+
+    // hands the box of every copy to the culler; the next Draw after its Run re-uploads the instance
+    // buffer if the set of visible copies changed. Call at most once per Run.
+    void Cull(FrustumCuller &culler)
+    {
+        Hide();
+        for (size_t i = 0; i < transforms.size(); i++)
+            Cull(culler, i);
+    }
+
+    // for culling only some copies, e.g. the ones a scene query found: Hide all of them, then hand
+    // the candidates to the culler one by one
+    void Hide()
+    {
+        visible.assign(transforms.size(), 0);
+    }
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    void Cull(FrustumCuller &culler, size_t copy)
+    {
+        if (model->IsReady())
+            culler.Add(model->bounds.Transformed(transforms[copy]), &visible[copy]);
+    }
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // picks the level of detail of one copy from the size of the whole model on screen
+    void SelectLod(const LodSelector &selector, size_t copy)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        if (copyLod.size() != transforms.size())
+            copyLod.assign(transforms.size(), 0);
+        if (model->IsReady())
+            copyLod[copy] = (unsigned char)selector.Level(model->bounds.Transformed(transforms[copy]), Mesh::MAX_LODS);
+    }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    void Draw(Shader &shader)
+    {
+        if (stale())
+            Update();
+        for (unsigned int level = 0; level < Mesh::MAX_LODS; level++)
+            model->DrawInstanced(shader, instanceVBO, levelCount[level], level, levelFirst[level]);
+    }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // depth only, every copy in one instanced draw per mesh whatever the camera culled; the copies come
+    // from a buffer of their own, filled again only when the transforms change
+    void DrawDepth(const PositionUniforms &uniforms, unsigned int lod = 0)
+    {
+        if (!model->IsReady() || transforms.empty())
+            return;
+        if (casterVBO == 0 || casterTransforms != transforms)
+        {
+            if (casterVBO == 0)
+                glGenBuffers(1, &casterVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, casterVBO);
+            glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            casterTransforms = transforms;
+        }
+        model->DrawDepthInstanced(uniforms, casterVBO, (unsigned int)transforms.size(), lod);
+    }
 
-        stbi_image_free(data);
+    // queues one instanced draw per mesh and level of detail instead of drawing right away, sorted
+    // by the copy nearest to the camera
+    void Submit(RenderQueue &queue, Shader &shader)
+    {
+        if (!model->IsReady())
+            return;
+        if (stale())
+            Update();
+        for (unsigned int level = 0; level < Mesh::MAX_LODS; level++)
+        {
+            if (levelCount[level] == 0)
+                continue;
+            glm::vec3 nearest;
+            float nearestDistance = FLT_MAX;
+            for (unsigned int i = levelFirst[level]; i < levelFirst[level] + levelCount[level]; i++)
+            {
+                glm::vec3 center = glm::vec3(visibleTransforms[i] * glm::vec4(model->bounds.Center(), 1.0f));
+                float distance = glm::length(center - queue.CameraPosition());
+                if (distance < nearestDistance)
+                {
+                    nearest = center;
+                    nearestDistance = distance;
+                }
+            }
+            for (Mesh &mesh : model->meshes)
+            {
+                RenderCommand &command = queue.AddMesh(RenderQueue::OPAQUE_PASS, shader, mesh, level, nearest);
+                command.instanceBuffer = instanceVBO;
+                command.instanceCount = levelCount[level];
+                command.firstInstance = levelFirst[level];
+            }
+        }
     }
-    else
+
+private:
+    unsigned int instanceVBO = 0;
+    // range of the instance buffer holding the copies at each level of detail
+    unsigned int levelFirst[Mesh::MAX_LODS] = {};
+    unsigned int levelCount[Mesh::MAX_LODS] = {};
+    // per copy result of the last Cull, level of detail and transform, and the ones the instance buffer was filled with
+    vector<unsigned char> visible, uploadedVisible;
+    vector<unsigned char> copyLod, uploadedLod;
+    vector<glm::mat4> uploadedTransforms;
+    vector<glm::mat4> visibleTransforms;
+    // every copy, for DrawDepth, and the transforms it was filled with
+    unsigned int casterVBO = 0;
+    vector<glm::mat4> casterTransforms;
+
+    bool stale() const
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        return instanceVBO == 0 || visible.size() != transforms.size() || visible != uploadedVisible || copyLod != uploadedLod
+               || transforms != uploadedTransforms;
     }
+};
+
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool normalMap)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
 
-    return textureID;
+    return TextureCache::Acquire(filename, gamma, normalMap);
 }
 #endif
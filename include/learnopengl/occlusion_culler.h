@@ -0,0 +1,172 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/frustum.h>
+
+#include <vector>
+
+// Hardware occlusion culling with temporal coherence. After the opaque geometry of a frame is drawn,
+// Test draws the bounding box of every object in view into a GL_ANY_SAMPLES_PASSED query, with color
+// and depth writes off. The results are read at the start of a later frame, and only once the GPU
+// reports them available, so the CPU never waits for a query; until a new result arrives an object
+// keeps its last one. Objects whose box was entirely hidden behind the depth buffer are skipped until a
+// later test finds the box visible again, which costs them one frame of delay when they reappear.
+// An object that just came into view, or whose box holds the camera, counts as visible.
+class OcclusionCuller
+{
+public:
+    explicit OcclusionCuller(unsigned int itemCount)
+        : boxShader("resources/shaders/occlusion_box.vs", "resources/shaders/occlusion_box.fs"),
+          items(itemCount)
+    {
+        boxMin = boxShader.getUniform<glm::vec3>("boxMin");
+        boxMax = boxShader.getUniform<glm::vec3>("boxMax");
+        setupBox();
+    }
+
+    ~OcclusionCuller()
+    {
+        for (Item &item : items)
+        {
+            if (item.query != 0)
+                glDeleteQueries(1, &item.query);
+        }
+        glDeleteVertexArrays(1, &boxVAO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteBuffers(1, &boxEBO);
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // reads every result the GPU has finished, without waiting for the others
+    void BeginFrame()
+    {
+        frame++;
+        for (Item &item : items)
+        {
+            if (!item.pending)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(item.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLint samplesPassed = 0;
+            glGetQueryObjectiv(item.query, GL_QUERY_RESULT, &samplesPassed);
+            item.visible = samplesPassed != 0;
+            item.pending = false;
+        }
+    }
+
+    // whether an object in view this frame is worth drawing; call once per frame for every object in
+    // the frustum, so that one coming back into view starts out visible
+    bool Visible(unsigned int index)
+    {
+        Item &item = items[index];
+        if (item.inFrustumFrame + 1 != frame)
+            item.visible = true;
+        item.inFrustumFrame = frame;
+        return item.visible;
+    }
+
+    // queues a box query for each object that has none in flight; boxes[i] is the world box of items[i].
+    // Call with the depth of this frame's occluders in the bound framebuffer.
+    void Test(const std::vector<unsigned int> &indices, const std::vector<BoundingBox> &boxes, const glm::vec3 &cameraPosition)
+    {
+        boxShader.use();
+        glBindVertexArray(boxVAO);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        // a visible object's own surfaces can lie exactly on its box (the flat top of a road), so the
+        // box is grown a little and may pass at equal depth
+        glDepthFunc(GL_LEQUAL);
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            Item &item = items[indices[i]];
+            const BoundingBox &box = boxes[i];
+            if (item.pending || box.IsEmpty())
+                continue;
+            glm::vec3 padding = box.Extents() * BOX_PADDING + glm::vec3(1.0f);
+            BoundingBox tested;
+            tested.min = box.min - padding;
+            tested.max = box.max + padding;
+            // from inside the box its faces are behind the camera or clipped by the near plane
+            if (contains(tested, cameraPosition))
+            {
+                item.visible = true;
+                continue;
+            }
+            if (item.query == 0)
+                glGenQueries(1, &item.query);
+            boxMin.set(tested.min);
+            boxMax.set(tested.max);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, item.query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            item.pending = true;
+        }
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindVertexArray(0);
+    }
+
+private:
+    // the near plane cuts a little in front of the camera, a box that close counts as holding it
+    static constexpr float CAMERA_CLEARANCE = 1.0f;
+    // the tested box is this much larger than the object's, relative to its size, plus one unit
+    static constexpr float BOX_PADDING = 0.01f;
+
+    struct Item
+    {
+        unsigned int query = 0;
+        bool pending = false;
+        bool visible = true;
+        unsigned long inFrustumFrame = 0;
+    };
+
+    Shader boxShader;
+    UniformHandle<glm::vec3> boxMin, boxMax;
+    std::vector<Item> items;
+    unsigned long frame = 0;
+    unsigned int boxVAO = 0, boxVBO = 0, boxEBO = 0;
+
+    static bool contains(const BoundingBox &box, const glm::vec3 &point)
+    {
+        glm::vec3 outside = glm::max(box.min - point, point - box.max);
+        return outside.x < CAMERA_CLEARANCE && outside.y < CAMERA_CLEARANCE && outside.z < CAMERA_CLEARANCE;
+    }
+
+    void setupBox()
+    {
+        float corners[] = {
+                0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,
+                0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 1.0f, 1.0f
+        };
+        // culling stays off while testing, so the winding doesn't matter
+        unsigned int indices[] = {
+                0, 1, 2,  2, 3, 0,   4, 5, 6,  6, 7, 4,
+                0, 1, 5,  5, 4, 0,   3, 2, 6,  6, 7, 3,
+                0, 3, 7,  7, 4, 0,   1, 2, 6,  6, 5, 1
+        };
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glGenBuffers(1, &boxEBO);
+        glBindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif
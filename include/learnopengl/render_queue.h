@@ -0,0 +1,236 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/geometry_buffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// One draw in a RenderQueue: the state it needs, which the queue binds, and either a mesh to draw or a
+// callback that sets its own uniforms and issues the draw call.
+struct RenderCommand
+{
+    static const unsigned int MAX_TEXTURES = 8;
+
+    struct TextureBinding
+    {
+        GLenum target = GL_TEXTURE_2D;
+        unsigned int id = 0;
+    };
+
+    uint64_t key = 0;
+    Shader *shader = nullptr;
+    // bound through GeometryBuffer::BindVertexArray; 0 for a callback that binds its own
+    unsigned int vertexArray = 0;
+    // textures[i] goes to unit i, units with id 0 are left as they are
+    unsigned int textureCount = 0;
+    TextureBinding textures[MAX_TEXTURES];
+
+    // a mesh at one level of detail, either a single copy (transform set through modelUniform) or
+    // instanceCount copies from instanceBuffer, starting at firstInstance
+    Mesh *mesh = nullptr;
+    unsigned int lod = 0;
+    const glm::mat4 *transform = nullptr;
+    UniformHandle<glm::mat4> modelUniform;
+    unsigned int instanceBuffer = 0, instanceCount = 0, firstInstance = 0;
+
+    // anything else
+    std::function<void()> draw;
+
+    void AddTexture(unsigned int id, GLenum target = GL_TEXTURE_2D)
+    {
+        if (textureCount < MAX_TEXTURES)
+            textures[textureCount++] = {target, id};
+    }
+
+    void SetTexture(unsigned int unit, unsigned int id, GLenum target = GL_TEXTURE_2D)
+    {
+        if (unit >= MAX_TEXTURES)
+            return;
+        textures[unit] = {target, id};
+        textureCount = std::max(textureCount, unit + 1);
+    }
+};
+
+// Collects a frame's draws and issues them sorted by a 64-bit key, binding a program, VAO or texture
+// only when it differs from the one the previous draw left bound. The key, most significant bits first:
+//   opaque:       pass | program | material | VAO | depth   state changes first, front to back within equal state
+//   transparent:  pass | inverted depth | program | material | VAO   back to front, as blending needs
+// with 4 bits of pass, 8 of program, 16 of material (the first texture), 12 of VAO and 24 of depth,
+// the distance from the camera as a fraction of the far plane. Program, texture and VAO names are
+// small numbers, so the truncation rarely merges two of them and then only costs sorting quality.
+//
+// Passes run in order, so the sky comes after all opaque draws and transparent ones after it.
+// Execute(upTo) issues the passes up to the given one and a later call continues from there, which
+// lets other work (the occlusion tests) run on the depth of the opaque pass alone.
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        OPAQUE_PASS = 0,
+        SKY_PASS = 1,
+        TRANSPARENT_PASS = 2
+    };
+
+    // binds issued and skipped by Execute since the caller last reset them
+    struct Stats
+    {
+        unsigned long programBinds = 0, programSkips = 0;
+        unsigned long vertexArrayBinds = 0, vertexArraySkips = 0;
+        unsigned long textureBinds = 0, textureSkips = 0;
+    };
+    Stats stats;
+
+    // starts a new frame
+    void Begin(const glm::vec3 &cameraPosition, float farPlane)
+    {
+        commands.clear();
+        order.clear();
+        next = 0;
+        camera = cameraPosition;
+        farDistance = farPlane;
+    }
+
+    const glm::vec3 &CameraPosition() const
+    {
+        return camera;
+    }
+
+    // a new command; fill in its state, draw and key before the next Add
+    RenderCommand &Add()
+    {
+        commands.emplace_back();
+        return commands.back();
+    }
+
+    // a command for one mesh, state and key filled in; the caller sets transform or the instance fields
+    RenderCommand &AddMesh(Pass pass, Shader &shader, Mesh &mesh, unsigned int lod, const glm::vec3 &center)
+    {
+        RenderCommand &command = Add();
+        command.shader = &shader;
+        command.vertexArray = mesh.VertexArray();
+        for (unsigned int i = 0; i < mesh.material.Size(); i++)
+            command.SetTexture(mesh.material.UnitOf(i), mesh.material[i].id, mesh.material[i].target);
+        command.mesh = &mesh;
+        command.lod = lod;
+        command.key = Key(pass, command, center);
+        return command;
+    }
+
+    // sort key of a command whose state is filled in, at the given world position
+    uint64_t Key(Pass pass, const RenderCommand &command, const glm::vec3 &position) const
+    {
+        uint64_t program = command.shader ? command.shader->ID & 0xFF : 0;
+        uint64_t material = command.textureCount ? command.textures[0].id & 0xFFFF : 0;
+        uint64_t vertexArray = command.vertexArray & 0xFFF;
+        float fraction = std::max(0.0f, std::min(glm::length(position - camera) / farDistance, 1.0f));
+        uint64_t depth = (uint64_t)(fraction * 0xFFFFFF);
+        uint64_t key = (uint64_t)pass << 60;
+        if (pass == TRANSPARENT_PASS)
+            return key | (0xFFFFFF - depth) << 36 | program << 28 | material << 12 | vertexArray;
+        return key | program << 52 | material << 36 | vertexArray << 24 | depth;
+    }
+
+    // issues every command of the passes up to upTo that hasn't been issued yet
+    void Execute(Pass upTo = TRANSPARENT_PASS)
+    {
+        if (order.size() != commands.size())
+        {
+            order.clear();
+            for (unsigned int i = 0; i < commands.size(); i++)
+                order.push_back(std::make_pair(commands[i].key, i));
+            std::sort(order.begin(), order.end());
+            next = 0;
+        }
+
+        // nothing is known about what other code left bound
+        unsigned int program = 0;
+        unsigned int boundTextures[RenderCommand::MAX_TEXTURES] = {};
+        unsigned int activeUnit = 0;
+        glActiveTexture(GL_TEXTURE0);
+        GeometryBuffer::Forget();
+
+        for (; next < order.size() && (order[next].first >> 60) <= (uint64_t)upTo; next++)
+        {
+            RenderCommand &command = commands[order[next].second];
+            if (command.shader && command.shader->ID != program)
+            {
+                command.shader->use();
+                program = command.shader->ID;
+                stats.programBinds++;
+            }
+            else
+                stats.programSkips++;
+
+            if (command.vertexArray != 0)
+            {
+                if (GeometryBuffer::BindVertexArray(command.vertexArray))
+                    stats.vertexArrayBinds++;
+                else
+                    stats.vertexArraySkips++;
+            }
+
+            for (unsigned int unit = 0; unit < command.textureCount; unit++)
+            {
+                const RenderCommand::TextureBinding &texture = command.textures[unit];
+                if (texture.id == 0)
+                    continue;
+                if (boundTextures[unit] == texture.id)
+                {
+                    stats.textureSkips++;
+                    continue;
+                }
+                if (activeUnit != unit)
+                {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    activeUnit = unit;
+                }
+                glBindTexture(texture.target, texture.id);
+                boundTextures[unit] = texture.id;
+                stats.textureBinds++;
+            }
+
+            if (command.mesh)
+            {
+                command.mesh->SetUniforms(*command.shader);
+                if (command.instanceCount > 0)
+                    command.mesh->DrawElementsInstanced(command.instanceBuffer, command.instanceCount, command.lod, command.firstInstance);
+                else
+                {
+                    command.modelUniform.set(*command.transform);
+                    command.mesh->DrawElements(command.lod);
+                }
+            }
+            else if (command.draw)
+            {
+                // a callback may change the active unit or bind its own VAO or textures
+                command.draw();
+                glActiveTexture(GL_TEXTURE0 + activeUnit);
+                std::fill(boundTextures, boundTextures + RenderCommand::MAX_TEXTURES, 0u);
+                if (command.vertexArray == 0)
+                    GeometryBuffer::Forget();
+            }
+        }
+        GeometryBuffer::Unbind();
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    std::vector<RenderCommand> commands;
+    std::vector<std::pair<uint64_t, unsigned int>> order;
+    size_t next = 0;
+    glm::vec3 camera = glm::vec3(0.0f);
+    float farDistance = 1.0f;
+};
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Bounding volume hierarchy over the world space boxes of the placed scene objects. Items are numbered
+// in the order they are inserted and the caller maps the numbers back to its instances. The tree is
+// binary with one item per leaf and answers frustum, sphere and ray queries by descending only into the
+// nodes the query touches, so their cost grows with the log of the item count plus the number of hits.
+//
+// Insert and Refit keep the tree up to date incrementally: a new leaf goes down the side whose box grows
+// least and its ancestors are refit on the way back. An item that moves out of its leaf box is taken
+// out and inserted again, with its box grown by a margin so that a steadily moving object only does so
+// every few frames. Rebuild builds the whole tree top-down again, which gives a better tree than many
+// single inserts, e.g. once after loading. Items with an empty box (a model still streaming in) stay
+// out of the tree until Refit gives them a real one.
+class SceneBvh
+{
+public:
+    unsigned int Insert(const BoundingBox &box)
+    {
+        unsigned int item = (unsigned int)items.size();
+        items.push_back(-1);
+        if (!box.IsEmpty())
+            insertLeaf(item, box);
+        return item;
+    }
+
+    // the item now covers box; nothing changes while it stays inside its leaf box
+    void Refit(unsigned int item, const BoundingBox &box, float margin = 0.0f)
+    {
+        int leaf = items[item];
+        if (leaf >= 0)
+        {
+            if (!box.IsEmpty() && contains(nodes[leaf].box, box))
+                return;
+            removeLeaf(leaf);
+            items[item] = -1;
+        }
+        if (box.IsEmpty())
+            return;
+        BoundingBox fat = box;
+        fat.min -= glm::vec3(margin);
+        fat.max += glm::vec3(margin);
+        insertLeaf(item, fat);
+    }
+
+    // rebuilds the tree top-down over the current leaf boxes, splitting at the median of the box
+    // centers along the longest axis
+    void Rebuild()
+    {
+        std::vector<std::pair<unsigned int, BoundingBox>> leaves;
+        for (unsigned int item = 0; item < items.size(); item++)
+        {
+            if (items[item] >= 0)
+                leaves.push_back(std::make_pair(item, nodes[items[item]].box));
+        }
+        nodes.clear();
+        freeNodes.clear();
+        root = leaves.empty() ? -1 : build(leaves, 0, leaves.size(), -1);
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)items.size();
+    }
+
+    // depth of the deepest leaf, 0 for an empty tree
+    unsigned int Depth() const
+    {
+        return root < 0 ? 0 : depth(root);
+    }
+
+    // every item whose box is at least partly inside the frustum, appended to out
+    void QueryFrustum(const Frustum &frustum, std::vector<unsigned int> &out) const
+    {
+        if (root < 0)
+            return;
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            const Node &node = nodes[index];
+            Frustum::Containment containment = frustum.Classify(node.box);
+            if (containment == Frustum::OUTSIDE)
+                continue;
+            if (containment == Frustum::INSIDE)
+                collect(index, out);
+            else if (node.IsLeaf())
+                out.push_back(node.item);
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // every item whose box the sphere overlaps, appended to out
+    void QuerySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &out) const
+    {
+        if (root < 0)
+            return;
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+            // squared distance from the center to the closest point of the box
+            glm::vec3 offset = center - glm::clamp(center, node.box.min, node.box.max);
+            if (glm::dot(offset, offset) > radius * radius)
+                continue;
+            if (node.IsLeaf())
+                out.push_back(node.item);
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // the item whose box the ray enters first within maxDistance; false if it hits none. Boxes are as
+    // precise as it gets, so a ray through the empty corner of a box still hits that item.
+    bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                 unsigned int &hitItem, float &hitDistance) const
+    {
+        if (root < 0)
+            return false;
+        // infinite where the direction is 0 (the camera front at pitch 0), rayHits handles those axes apart
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float nearest = maxDistance;
+        bool hit = false;
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+            float entry;
+            if (!rayHits(node.box, origin, inverse, nearest, entry))
+                continue;
+            if (node.IsLeaf())
+            {
+                nearest = entry;
+                hitItem = node.item;
+                hit = true;
+                continue;
+            }
+            // the nearer child goes on top, so its hits shorten the ray before the other one is visited
+            float leftEntry, rightEntry;
+            bool left = rayHits(nodes[node.left].box, origin, inverse, nearest, leftEntry);
+            bool right = rayHits(nodes[node.right].box, origin, inverse, nearest, rightEntry);
+            if (left && right && leftEntry < rightEntry)
+            {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+            else
+            {
+                if (left)
+                    stack.push_back(node.left);
+                if (right)
+                    stack.push_back(node.right);
+            }
+        }
+        if (hit)
+            hitDistance = nearest;
+        return hit;
+    }
+
+private:
+    struct Node
+    {
+        BoundingBox box;
+        int parent = -1;
+        int left = -1, right = -1;
+        unsigned int item = 0; // leaves only
+
+        bool IsLeaf() const
+        {
+            return left < 0;
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<int> items; // leaf node of every item, -1 while it is out of the tree
+    int root = -1;
+
+    static bool contains(const BoundingBox &outer, const BoundingBox &inner)
+    {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+            && outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+    }
+
+    static float area(const BoundingBox &box)
+    {
+        glm::vec3 size = box.max - box.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    static BoundingBox merged(const BoundingBox &a, const BoundingBox &b)
+    {
+        BoundingBox box = a;
+        box.Extend(b);
+        return box;
+    }
+
+    // slab test; entry is where the ray enters the box (0 if it starts inside)
+    static bool rayHits(const BoundingBox &box, const glm::vec3 &origin, const glm::vec3 &inverse,
+                        float maxDistance, float &entry)
+    {
+        float enter = 0.0f, exit = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // a ray parallel to the slab (direction 0 on this axis, inverse infinite) stays inside it all
+            // the way or never enters it; the products below would be NaN for an origin on a slab plane
+            if (std::isinf(inverse[axis]))
+            {
+                if (origin[axis] < box.min[axis] || origin[axis] > box.max[axis])
+                    return false;
+                continue;
+            }
+            float t0 = (box.min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (box.max[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+            if (enter > exit)
+                return false;
+        }
+        entry = enter;
+        return true;
+    }
+
+    int allocate()
+    {
+        if (!freeNodes.empty())
+        {
+            int index = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[index] = Node();
+            return index;
+        }
+        nodes.push_back(Node());
+        return (int)nodes.size() - 1;
+    }
+
+    // recomputes the boxes from index up to the root, stopping early where a box doesn't change
+    void refitUpwards(int index)
+    {
+        while (index >= 0)
+        {
+            Node &node = nodes[index];
+            BoundingBox box = merged(nodes[node.left].box, nodes[node.right].box);
+            if (box.min == node.box.min && box.max == node.box.max)
+                return;
+            node.box = box;
+            index = node.parent;
+        }
+    }
+
+    void insertLeaf(unsigned int item, const BoundingBox &box)
+    {
+        int leaf = allocate();
+        nodes[leaf].box = box;
+        nodes[leaf].item = item;
+        items[item] = leaf;
+        if (root < 0)
+        {
+            root = leaf;
+            return;
+        }
+
+        // walk down to the sibling whose box grows least by taking the new one in
+        int sibling = root;
+        while (!nodes[sibling].IsLeaf())
+        {
+            const Node &node = nodes[sibling];
+            float leftGrowth = area(merged(nodes[node.left].box, box)) - area(nodes[node.left].box);
+            float rightGrowth = area(merged(nodes[node.right].box, box)) - area(nodes[node.right].box);
+            sibling = leftGrowth <= rightGrowth ? node.left : node.right;
+        }
+
+        int parent = allocate();
+        int grandparent = nodes[sibling].parent;
+        nodes[parent].parent = grandparent;
+        nodes[parent].left = sibling;
+        nodes[parent].right = leaf;
+        nodes[parent].box = merged(nodes[sibling].box, box);
+        nodes[sibling].parent = parent;
+        nodes[leaf].parent = parent;
+        if (grandparent < 0)
+            root = parent;
+        else
+        {
+            if (nodes[grandparent].left == sibling)
+                nodes[grandparent].left = parent;
+            else
+                nodes[grandparent].right = parent;
+            refitUpwards(grandparent);
+        }
+    }
+
+    // the leaf's sibling takes the place of their parent
+    void removeLeaf(int leaf)
+    {
+        freeNodes.push_back(leaf);
+        if (leaf == root)
+        {
+            root = -1;
+            return;
+        }
+        int parent = nodes[leaf].parent;
+        int grandparent = nodes[parent].parent;
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        freeNodes.push_back(parent);
+        nodes[sibling].parent = grandparent;
+        if (grandparent < 0)
+        {
+            root = sibling;
+            return;
+        }
+        if (nodes[grandparent].left == parent)
+            nodes[grandparent].left = sibling;
+        else
+            nodes[grandparent].right = sibling;
+        refitUpwards(grandparent);
+    }
+
+    int build(std::vector<std::pair<unsigned int, BoundingBox>> &leaves, size_t begin, size_t end, int parent)
+    {
+        int index = allocate();
+        nodes[index].parent = parent;
+        if (end - begin == 1)
+        {
+            nodes[index].box = leaves[begin].second;
+            nodes[index].item = leaves[begin].first;
+            items[leaves[begin].first] = index;
+            return index;
+        }
+
+        BoundingBox centers;
+        for (size_t i = begin; i < end; i++)
+            centers.Extend(leaves[i].second.Center());
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(leaves.begin() + begin, leaves.begin() + middle, leaves.begin() + end,
+                         [axis](const std::pair<unsigned int, BoundingBox> &a, const std::pair<unsigned int, BoundingBox> &b) {
+                             return a.second.Center()[axis] < b.second.Center()[axis];
+                         });
+
+        // nodes may reallocate while the children are built, so no reference into it is kept
+        int left = build(leaves, begin, middle, index);
+        int right = build(leaves, middle, end, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        nodes[index].box = merged(nodes[left].box, nodes[right].box);
+        return index;
+    }
+
+    // appends every item below index
+    void collect(int index, std::vector<unsigned int> &out) const
+    {
+        std::vector<int> stack(1, index);
+        while (!stack.empty())
+        {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.IsLeaf())
+                out.push_back(node.item);
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    unsigned int depth(int index) const
+    {
+        const Node &node = nodes[index];
+        if (node.IsLeaf())
+            return 1;
+        return 1 + std::max(depth(node.left), depth(node.right));
+    }
+};
+
+#endif
@@ -8,17 +8,23 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <common.h>
+#include <learnopengl/uniform_handle.h>
+#include <learnopengl/uniform_buffer.h>
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly; defines, if given, is a space separated list of
+    // macro names #defined in every stage right after its #version line, for variants of one source.
+    // A line #include "file" is replaced by that file, looked up next to the including shader
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const char* defines = nullptr)
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
+        std::string geometryPathString(geometryPath != nullptr ? geometryPath : "");
 
         vertexPath = vertexPathString.c_str();
         fragmentPath= fragmentPathString.c_str();
@@ -51,7 +57,6 @@ public:
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
-                std::string geometryPathString(geometryPath);
                 geometryPath = geometryPathString.c_str();
                 gShaderFile.open(geometryPath);
                 std::stringstream gShaderStream;
@@ -64,6 +69,16 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        addIncludes(vertexCode, vertexPathString);
+        addIncludes(fragmentCode, fragmentPathString);
+        if (geometryPath != nullptr)
+            addIncludes(geometryCode, geometryPathString);
+        if (defines != nullptr)
+        {
+            addDefines(vertexCode, defines);
+            addDefines(fragmentCode, defines);
+            addDefines(geometryCode, defines);
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -96,6 +111,10 @@ public:
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        // look every active uniform up once, the set* functions below only consult this table
+        uniformLocations = reflectUniforms(ID);
+        // the shared Camera/Lights blocks are fed from uniform buffers, see uniform_buffer.h
+        bindUniformBlocks(ID);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -109,66 +128,133 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // location of an active uniform, -1 if the program has none by that name (no driver call)
+    // ------------------------------------------------------------------------
+    int getLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it == uniformLocations.end() ? -1 : it->second;
+    }
+    // typed handle for hot paths: resolve it once, then handle.set(value) is a bare glUniform* call
+    // ------------------------------------------------------------------------
+    template <typename T>
+    UniformHandle<T> getUniform(const std::string &name) const
+    {
+        return UniformHandle<T>(getLocation(name));
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(getLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(getLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(getLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(getLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(getLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(getLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    std::unordered_map<std::string, int> uniformLocations;
+
+    // GLSL has no #include of its own; code shared between shaders (shadows.glsl) is pasted in here
+    static void addIncludes(std::string &code, const std::string &path)
+    {
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        size_t lineStart = 0;
+        // a file that ends up including itself stops here instead of growing forever
+        int includes = 0;
+        while (lineStart < code.size() && includes < 64)
+        {
+            size_t lineEnd = code.find('\n', lineStart);
+            if (lineEnd == std::string::npos)
+                lineEnd = code.size();
+            std::string line = code.substr(lineStart, lineEnd - lineStart);
+            size_t directive = line.find_first_not_of(" \t");
+            size_t open = line.find('"'), close = line.rfind('"');
+            if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0 || open == close)
+            {
+                lineStart = lineEnd + 1;
+                continue;
+            }
+            std::string file = directory + line.substr(open + 1, close - open - 1);
+            std::ifstream in(file);
+            std::stringstream included;
+            if (in)
+                included << in.rdbuf();
+            else
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << file << std::endl;
+            // the included code is scanned too, so includes may nest
+            code.replace(lineStart, lineEnd - lineStart, included.str());
+            includes++;
+        }
+    }
+
+    // inserts a #define line per name after the #version line, which has to stay the first one
+    // ------------------------------------------------------------------------
+    static void addDefines(std::string &code, const char* defines)
+    {
+        if (code.empty())
+            return;
+        std::stringstream names(defines);
+        std::string name, lines;
+        while (names >> name)
+            lines += "#define " + name + "\n";
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            code.insert(0, lines);
+        else
+            code.insert(lineEnd + 1, lines);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
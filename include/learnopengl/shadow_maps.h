@@ -0,0 +1,361 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/model.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/geometry_buffer.h>
+#include <learnopengl/uniform_buffer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+// One cascade's depth pass as the draw callbacks of CascadedShadowMaps::Render see it: Draw renders a
+// caster into the cascade with the program its kind needs, at a level of detail that gets coarser with
+// every cascade (a texel of the last one covers a few units, finer triangles are wasted on it).
+class ShadowPass
+{
+public:
+    unsigned int cascade;
+
+    void Draw(ModelInstance &instance)
+    {
+        use(*shader);
+        instance.DrawDepth(positions, modelUniform, cascade);
+    }
+
+    void Draw(ModelInstanceBatch &batch)
+    {
+        use(*instancedShader);
+        batch.DrawDepth(instancedPositions, cascade);
+    }
+
+private:
+    friend class CascadedShadowMaps;
+
+    Shader *shader = nullptr, *instancedShader = nullptr;
+    UniformHandle<glm::mat4> modelUniform;
+    PositionUniforms positions, instancedPositions;
+    unsigned int program = 0; // in use
+
+    void use(Shader &next)
+    {
+        if (next.ID == program)
+            return;
+        next.use();
+        program = next.ID;
+    }
+};
+
+// Cascaded shadow maps for the directional light. The view frustum up to shadowDistance is split into
+// CASCADES slices, each covered by an orthographic depth map from the light, all layers of one
+// GL_TEXTURE_2D_ARRAY that the lit shaders sample with 3x3 PCF (ShadowFactor in model_lighting.fs,
+// planeShader.fs and deferred_directional.fs).
+//
+// Nearly everything in the scene stands still, so the static casters are rendered into a second array
+// that is kept from frame to frame: a cascade covers the bounding sphere of its slice, whose size only
+// depends on the projection, and its window is moved in steps of a quarter of that radius, so a static
+// layer is only rendered again when the camera crossed a step, the light turned or Invalidate was
+// called. Each frame the cached layers are copied into the sampled array (a depth blit, far cheaper
+// than drawing the scene) only where dynamic casters are composited on top, or were last frame.
+//
+// Everything here runs on the GL thread.
+class CascadedShadowMaps
+{
+public:
+    static const unsigned int CASCADES = 4;
+    // the ClusteredLights buffers take 13-15, the materials 0-7
+    static const unsigned int SHADOW_MAP_UNIT = 12;
+
+    // depth passes since the caller last reset them
+    struct Stats
+    {
+        unsigned long staticRenders = 0;  // cascades the static casters were drawn into again
+        unsigned long dynamicRenders = 0; // cascades dynamic casters were drawn into
+        unsigned long composites = 0;     // cached layers copied into the sampled array
+    };
+    Stats stats;
+
+    // how far from the camera shadows reach, and how the splits between the cascades go from evenly
+    // spaced (0) to logarithmic (1)
+    float shadowDistance = 3000.0f;
+    float splitLambda = 0.8f;
+
+    explicit CascadedShadowMaps(unsigned int resolution = 2048)
+        : depthShader("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs"),
+          depthInstancedShader("resources/shaders/shadow_depth_instanced.vs", "resources/shaders/shadow_depth.fs"),
+          paramsBuffer(SHADOWS_BLOCK_BINDING), resolution(resolution)
+    {
+        modelUniform = depthShader.getUniform<glm::mat4>("model");
+        lightSpaceUniform = depthShader.getUniform<glm::mat4>("lightSpace");
+        instancedLightSpaceUniform = depthInstancedShader.getUniform<glm::mat4>("lightSpace");
+        positions.offset = depthShader.getUniform<glm::vec3>("positionOffset");
+        positions.scale = depthShader.getUniform<glm::vec3>("positionScale");
+        instancedPositions.offset = depthInstancedShader.getUniform<glm::vec3>("positionOffset");
+        instancedPositions.scale = depthInstancedShader.getUniform<glm::vec3>("positionScale");
+
+        // static layers are only ever copied, the sampled ones compare in hardware: with linear filtering
+        // every lookup is already a 2x2 PCF
+        glGenTextures(2, textures);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, CASCADES, 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+            GLint filter = i == SAMPLED ? GL_LINEAR : GL_NEAREST;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+            // outside the map nothing is in shadow
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            float border[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+            glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[SAMPLED]);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // depth only framebuffers, the layer is attached when it is drawn
+        glGenFramebuffers(2, framebuffers);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[i], 0, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::SHADOWS:: shadow map framebuffer is not complete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[SAMPLED]);
+        glActiveTexture(GL_TEXTURE0);
+        // off until the first Update
+        paramsBuffer.Upload(params);
+    }
+
+    ~CascadedShadowMaps()
+    {
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteTextures(2, textures);
+    }
+
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    // sets the sampler uniform of a program that includes ShadowFactor
+    template <typename ShaderType>
+    static void BindSamplers(ShaderType &shader)
+    {
+        shader.use();
+        shader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    }
+
+    // fits the cascades to this frame's camera and uploads them, which turns the shadows on; fovY in
+    // radians, the same values that went into glm::perspective. casters is the world box around
+    // everything that casts a shadow, dynamic casters over their whole path: it sets the depth range
+    // of the cascades, so a caster outside it can be clipped.
+    void Update(const glm::mat4 &view, float fovY, float aspect, float nearPlane, const glm::vec3 &lightDirection,
+                const BoundingBox &casters)
+    {
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        glm::vec3 cameraPosition = glm::vec3(cameraToWorld[3]);
+        glm::vec3 forward = -glm::normalize(glm::vec3(cameraToWorld[2]));
+
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+        // depth range of the casters in light space, looking down -z
+        float nearest = -FLT_MAX, farthest = FLT_MAX;
+        if (!casters.IsEmpty())
+        {
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 point((corner & 1) ? casters.max.x : casters.min.x, (corner & 2) ? casters.max.y : casters.min.y,
+                                (corner & 4) ? casters.max.z : casters.min.z);
+                float z = glm::vec3(lightRotation * glm::vec4(point, 1.0f)).z;
+                nearest = std::max(nearest, z);
+                farthest = std::min(farthest, z);
+            }
+        }
+
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+        float k2 = tanX * tanX + tanY * tanY;
+        float sliceNear = nearPlane;
+        float farPlane = std::max(shadowDistance, nearPlane);
+        for (unsigned int i = 0; i < CASCADES; i++)
+        {
+            // practical split scheme: a blend of logarithmic and uniform splits
+            float fraction = (float)(i + 1) / CASCADES;
+            float logarithmic = nearPlane * std::pow(farPlane / nearPlane, fraction);
+            float uniform = nearPlane + (farPlane - nearPlane) * fraction;
+            float sliceFar = splitLambda * logarithmic + (1.0f - splitLambda) * uniform;
+
+            // smallest sphere around the slice, centered on the view axis; its radius doesn't change
+            // while the camera moves or turns, so neither does the size of a shadow texel
+            float center = std::min((sliceFar + sliceNear) * (1.0f + k2) * 0.5f, sliceFar);
+            float radius = std::sqrt((sliceFar - center) * (sliceFar - center) + k2 * sliceFar * sliceFar);
+            glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(cameraPosition + forward * center, 1.0f));
+
+            // the window moves in whole steps of about a quarter radius, large enough to cover the sphere
+            // wherever it is inside the step, and the step is a whole number of texels so the texel
+            // grid stays where it is as well
+            float texel = 2.0f * radius * 1.25f / resolution;
+            float step = std::max(1.0f, std::floor(radius * 0.25f / texel)) * texel;
+            float halfExtent = 0.5f * texel * resolution;
+            glm::vec2 snapped = glm::vec2(std::floor(lightCenter.x / step), std::floor(lightCenter.y / step)) * step;
+
+            // a unit of slack so casters touching the box aren't clipped
+            float zNear = (casters.IsEmpty() ? -(lightCenter.z + radius) : -nearest) - 1.0f;
+            float zFar = (casters.IsEmpty() ? -(lightCenter.z - radius) : -farthest) + 1.0f;
+            glm::mat4 projection = glm::ortho(snapped.x - halfExtent, snapped.x + halfExtent, snapped.y - halfExtent,
+                                              snapped.y + halfExtent, zNear, zFar);
+
+            cascades[i].lightSpace = projection * lightRotation;
+            params.lightSpace[i] = cascades[i].lightSpace;
+            params.cascadeEnds[i] = sliceFar;
+            params.texelSizes[i] = texel;
+            sliceNear = sliceFar;
+        }
+        params.cascadeCount = CASCADES;
+        paramsBuffer.Upload(params);
+    }
+
+    // renders the cascades fitted by the last Update: the static casters into the layers whose cached
+    // depth is out of date, then the dynamic casters inside dynamicBounds over a copy of the cached
+    // depth of every cascade they reach. Both callbacks are called once per cascade they draw into.
+    // Leaves the default framebuffer bound with the viewport it had.
+    void Render(const std::function<void(ShadowPass&)> &drawStatic, const BoundingBox &dynamicBounds,
+                const std::function<void(ShadowPass&)> &drawDynamic)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, resolution, resolution);
+        // slope scaled bias against acne, the lookups add a normal offset on top
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        GeometryBuffer::Forget();
+
+        for (unsigned int i = 0; i < CASCADES; i++)
+        {
+            Cascade &cascade = cascades[i];
+            bool staticChanged = !cascade.cached || cascade.cachedLightSpace != cascade.lightSpace;
+            if (staticChanged)
+            {
+                attach(CACHED, i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                draw(i, drawStatic);
+                cascade.cached = true;
+                cascade.cachedLightSpace = cascade.lightSpace;
+                stats.staticRenders++;
+            }
+
+            bool dynamic = !dynamicBounds.IsEmpty() && Frustum(cascade.lightSpace).Intersects(dynamicBounds);
+            if (staticChanged || dynamic || cascade.dynamic)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[CACHED]);
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[CACHED], 0, i);
+                attach(SAMPLED, i);
+                glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                stats.composites++;
+            }
+            if (dynamic)
+            {
+                draw(i, drawDynamic);
+                stats.dynamicRenders++;
+            }
+            cascade.dynamic = dynamic;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        GeometryBuffer::Unbind();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // the cached static depth is drawn again on the next Render, e.g. after a static caster appeared
+    void Invalidate()
+    {
+        for (Cascade &cascade : cascades)
+            cascade.cached = false;
+    }
+
+    // no shadows until the next Update; the cached layers stay valid
+    void Disable()
+    {
+        if (params.cascadeCount == 0)
+            return;
+        params.cascadeCount = 0;
+        paramsBuffer.Upload(params);
+    }
+
+private:
+    // std140 mirror of the Shadows block in the lit shaders
+    struct Params
+    {
+        glm::mat4 lightSpace[CASCADES];
+        float cascadeEnds[CASCADES]; // view depth where each cascade ends, a vec4
+        float texelSizes[CASCADES];  // world size of a shadow map texel, a vec4
+        int cascadeCount;            // 0 turns the shadows off
+        int padding[3];
+    };
+
+    struct Cascade
+    {
+        glm::mat4 lightSpace = glm::mat4(1.0f);
+        // the static layer holds the depth of cachedLightSpace
+        bool cached = false;
+        glm::mat4 cachedLightSpace = glm::mat4(1.0f);
+        // dynamic casters were composited into the sampled layer
+        bool dynamic = false;
+    };
+
+    enum { CACHED = 0, SAMPLED = 1 };
+
+    Shader depthShader, depthInstancedShader;
+    UniformHandle<glm::mat4> modelUniform, lightSpaceUniform, instancedLightSpaceUniform;
+    PositionUniforms positions, instancedPositions;
+    UniformBuffer<Params> paramsBuffer;
+    Params params = {};
+    unsigned int resolution;
+    unsigned int textures[2] = {}, framebuffers[2] = {};
+    Cascade cascades[CASCADES];
+
+    // binds a layer of one of the arrays as the draw framebuffer
+    void attach(int array, unsigned int layer)
+    {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[array]);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[array], 0, layer);
+    }
+
+    void draw(unsigned int cascade, const std::function<void(ShadowPass&)> &callback)
+    {
+        depthShader.use();
+        lightSpaceUniform.set(cascades[cascade].lightSpace);
+        depthInstancedShader.use();
+        instancedLightSpaceUniform.set(cascades[cascade].lightSpace);
+
+        ShadowPass pass;
+        pass.cascade = cascade;
+        pass.shader = &depthShader;
+        pass.instancedShader = &depthInstancedShader;
+        pass.modelUniform = modelUniform;
+        pass.positions = positions;
+        pass.instancedPositions = instancedPositions;
+        pass.program = depthInstancedShader.ID;
+        callback(pass);
+    }
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Repacks 2D textures into GL_TEXTURE_2D_ARRAYs: textures of the same size, internal format and (for
+// compressed ones) number of mip levels become layers of one array. A model with many small materials,
+// like the diner, then binds a handful of arrays instead of a texture per mesh, and meshes sampling the
+// same arrays draw back to back without any texture bind in between (RenderQueue sorts them together);
+// the layer of each texture goes to the shader as a uniform.
+//
+// GL 3.3 has no glCopyImageSubData, so the texels make a round trip through client memory: compressed
+// textures copy every level as is, uncompressed ones copy level 0 and the array regenerates its mipmaps.
+// This runs once per model on the GL thread, after its textures are resident.
+class TextureArrays
+{
+public:
+    // where a packed texture went
+    struct Layer
+    {
+        unsigned int array;
+        unsigned int layer;
+    };
+
+    // packs every texture in textures (duplicates are packed once); false if there was nothing to pack
+    bool Pack(const std::vector<unsigned int> &textures)
+    {
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        std::map<std::tuple<int, int, int, int>, std::vector<unsigned int>> groups;
+        for (unsigned int texture : textures)
+        {
+            if (texture == 0 || layers.count(texture))
+                continue;
+            Format format = describe(texture);
+            if (format.width == 0 || format.height == 0)
+                continue;
+            std::vector<unsigned int> &group = groups[std::make_tuple(format.width, format.height, format.internalFormat, format.levels)];
+            if (std::find(group.begin(), group.end(), texture) == group.end())
+                group.push_back(texture);
+        }
+
+        for (auto &group : groups)
+        {
+            const std::vector<unsigned int> &members = group.second;
+            for (size_t first = 0; first < members.size(); first += (size_t)maxLayers)
+            {
+                std::vector<unsigned int> slice(members.begin() + first,
+                                                members.begin() + std::min(members.size(), first + (size_t)maxLayers));
+                build(slice, describe(slice[0]));
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return !groups.empty();
+    }
+
+    bool Find(unsigned int texture, Layer &layer) const
+    {
+        auto it = layers.find(texture);
+        if (it == layers.end())
+            return false;
+        layer = it->second;
+        return true;
+    }
+
+    unsigned int Count() const
+    {
+        return (unsigned int)arrays.size();
+    }
+
+    unsigned int PackedTextures() const
+    {
+        return (unsigned int)layers.size();
+    }
+
+    // deletes the arrays; the source textures were never touched
+    void Release()
+    {
+        if (!arrays.empty())
+            glDeleteTextures((GLsizei)arrays.size(), arrays.data());
+        arrays.clear();
+        layers.clear();
+    }
+
+private:
+    struct Format
+    {
+        int width = 0, height = 0;
+        int internalFormat = 0;
+        int levels = 1;    // copied levels, only more than one for compressed textures
+        bool compressed = false;
+    };
+
+    std::vector<unsigned int> arrays;
+    std::unordered_map<unsigned int, Layer> layers;
+
+    static Format describe(unsigned int texture)
+    {
+        Format format;
+        GLint compressed = GL_FALSE, maxLevel = 0;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        format.compressed = compressed == GL_TRUE;
+        if (format.compressed)
+        {
+            // TextureCache sets GL_TEXTURE_MAX_LEVEL to the last level a KTX file carries
+            glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+            int levels = 1;
+            while (levels <= maxLevel && std::max(format.width >> levels, format.height >> levels) > 0)
+                levels++;
+            format.levels = levels;
+        }
+        return format;
+    }
+
+    void build(const std::vector<unsigned int> &members, const Format &format)
+    {
+        GLsizei layerCount = (GLsizei)members.size();
+        unsigned int array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+
+        std::vector<unsigned char> texels;
+        if (format.compressed)
+        {
+            for (int level = 0; level < format.levels; level++)
+            {
+                GLint width = std::max(1, format.width >> level), height = std::max(1, format.height >> level);
+                GLint levelBytes = 0;
+                glBindTexture(GL_TEXTURE_2D, members[0]);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelBytes);
+                texels.resize((size_t)levelBytes);
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, layerCount,
+                                       0, levelBytes * layerCount, NULL);
+                for (GLsizei layer = 0; layer < layerCount; layer++)
+                {
+                    glBindTexture(GL_TEXTURE_2D, members[layer]);
+                    glGetCompressedTexImage(GL_TEXTURE_2D, level, texels.data());
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+                                              format.internalFormat, levelBytes, texels.data());
+                }
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, format.levels - 1);
+        }
+        else
+        {
+            // read back as RGBA bytes whatever the format (rows stay 4 byte aligned), the upload converts them back
+            texels.resize((size_t)format.width * format.height * 4);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format.internalFormat, format.width, format.height, layerCount,
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            for (GLsizei layer = 0; layer < layerCount; layer++)
+            {
+                glBindTexture(GL_TEXTURE_2D, members[layer]);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, format.width, format.height, 1,
+                                GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+
+        // the sampling state TextureCache gives its 2D textures
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        arrays.push_back(array);
+        for (GLsizei layer = 0; layer < layerCount; layer++)
+            layers[members[layer]] = {array, (unsigned int)layer};
+    }
+};
+
+#endif
@@ -0,0 +1,656 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/ktx.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// S3TC (EXT_texture_compression_s3tc + EXT_texture_sRGB) isn't part of core 3.3, so glad doesn't define it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Process-wide texture registry. Every texture load in the program (model materials, loadTexture,
+// loadCubemap) goes through here, so an image is decoded and uploaded at most once per process.
+//
+// Lookups are O(1) on two keys:
+//  - the canonical file path (fast path, no file access at all for a repeated load), and
+//  - a hash of the file contents, so identical files living in different directories
+//    (road/, road1/ and road2/ ship the same Road007_2K_Color.jpg) end up as one GL texture.
+// Each Acquire adds a reference, Release drops one. Textures nobody references anymore stay
+// resident until they are explicitly evicted with Evict/EvictUnused.
+//
+// Between BeginBatch and EndBatch, Acquire only reads the file and hands out the texture name;
+// EndBatch then decodes all queued images on ThreadPool::Shared() and uploads them on the
+// calling (GL) thread as they come in, printing a timing report. AcquireStreamed is the
+// non-blocking variant used by streamed models: decodes run in the background and Update()
+// uploads a few finished images per frame.
+//
+// 2D textures are stored block compressed (BC1/BC3 color, BC4 grey, BC5 normal maps) with a full
+// mip chain. The first run encodes them on the decode threads and writes <image>.srgb.ktx next to
+// the source (.linear.ktx or .normal.ktx, one file per way the image is loaded); later runs read that
+// file and upload its levels with glCompressedTexImage2D, skipping both the image decode and
+// glGenerateMipmap. Sizes that aren't a multiple of 4, color images without S3TC support and cubemaps
+// stay uncompressed.
+class TextureCache
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // loads (or reuses) a GL_TEXTURE_2D with mipmaps and repeat wrapping; gammaCorrection selects an sRGB internal format,
+    // normalMap a two channel (BC5) encoding whose z the shader rebuilds from x and y
+    static unsigned int Acquire(const std::string &path, bool gammaCorrection = false, bool normalMap = false)
+    {
+        std::string canonical = FileSystem::getCanonicalPath(path);
+        std::string pathKey = canonical + keySuffix(gammaCorrection, normalMap);
+        if (unsigned int id = lookupPath(pathKey))
+            return id;
+
+        std::vector<unsigned char> bytes;
+        Clock::time_point readStart = Clock::now();
+        if (!readFile(canonical, bytes))
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return 0;
+        }
+        uint64_t contentKey = HashContents(bytes, gammaCorrection, normalMap);
+        batch().readSeconds += secondsSince(readStart);
+        if (unsigned int id = lookupContent(contentKey, pathKey))
+            return id;
+
+        return create2D(path, pathKey, contentKey, gammaCorrection, normalMap, bytes, batch().active ? Queue_Batch : Queue_Inline);
+    }
+
+    // Acquire for a file a worker thread has already read and hashed (see ReadFile/HashContents).
+    // A new image is decoded in the background and uploaded by Update(); until then IsResident is false.
+    static unsigned int AcquireStreamed(const std::string &path, bool gammaCorrection, std::vector<unsigned char> &bytes, uint64_t contentHash,
+                                        bool normalMap = false)
+    {
+        std::string pathKey = FileSystem::getCanonicalPath(path) + keySuffix(gammaCorrection, normalMap);
+        if (unsigned int id = lookupPath(pathKey))
+            return id;
+        if (bytes.empty())
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return 0;
+        }
+        if (unsigned int id = lookupContent(contentHash, pathKey))
+            return id;
+
+        return create2D(path, pathKey, contentHash, gammaCorrection, normalMap, bytes, Queue_Stream);
+    }
+
+    // loads (or reuses) a cubemap from its six faces, in +X, -X, +Y, -Y, +Z, -Z order
+    static unsigned int AcquireCubemap(const std::vector<std::string> &faces)
+    {
+        std::string pathKey;
+        for (const std::string &face : faces)
+            pathKey += FileSystem::getCanonicalPath(face) + "|";
+        pathKey += "#cubemap";
+        if (unsigned int id = lookupPath(pathKey))
+            return id;
+
+        std::vector<std::vector<unsigned char>> bytes(faces.size());
+        Clock::time_point readStart = Clock::now();
+        uint64_t contentKey = 0x43554245ull;
+        for (unsigned int i = 0; i < faces.size(); i++)
+        {
+            readFile(faces[i], bytes[i]);
+            contentKey = hashBytes(bytes[i].data(), bytes[i].size(), contentKey);
+        }
+        batch().readSeconds += secondsSince(readStart);
+        if (unsigned int id = lookupContent(contentKey, pathKey))
+            return id;
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        insert(textureID, pathKey, contentKey);
+
+        for (unsigned int i = 0; i < faces.size(); i++)
+        {
+            PendingImage image;
+            image.id = textureID;
+            image.target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            image.gammaCorrection = false;
+            image.path = faces[i];
+            image.bytes.swap(bytes[i]);
+            enqueue(image, batch().active ? Queue_Batch : Queue_Inline);
+        }
+        return textureID;
+    }
+
+    // starts queueing image decodes instead of doing them inline
+    static void BeginBatch()
+    {
+        batch().active = true;
+        batch().readSeconds = 0.0;
+    }
+
+    // decodes everything queued since BeginBatch on all cores and uploads the results on this thread
+    static void EndBatch()
+    {
+        Batch &state = batch();
+        state.active = false;
+        std::vector<PendingImage> images;
+        images.swap(state.images);
+
+        // the workers only touch this through their own shared_ptr, so it outlives the last notify
+        struct Completion
+        {
+            std::vector<PendingImage> images;
+            std::mutex mutex;
+            std::condition_variable signal;
+            std::deque<unsigned int> done;
+        };
+        std::shared_ptr<Completion> completion = std::make_shared<Completion>();
+        completion->images.swap(images);
+        unsigned int count = (unsigned int)completion->images.size();
+
+        Clock::time_point start = Clock::now();
+        ThreadPool &pool = ThreadPool::Shared();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            pool.Submit([completion, i]() {
+                decode(completion->images[i]);
+                std::lock_guard<std::mutex> lock(completion->mutex);
+                completion->done.push_back(i);
+                completion->signal.notify_one();
+            });
+        }
+
+        // upload in completion order so the GL thread works while the pool is still decoding
+        double uploadSeconds = 0.0;
+        double uploadedMB = 0.0;
+        for (unsigned int n = 0; n < count; n++)
+        {
+            unsigned int i;
+            {
+                std::unique_lock<std::mutex> lock(completion->mutex);
+                completion->signal.wait(lock, [&completion]() { return !completion->done.empty(); });
+                i = completion->done.front();
+                completion->done.pop_front();
+            }
+            PendingImage &image = completion->images[i];
+            Clock::time_point uploadStart = Clock::now();
+            uploadedMB += uploadBytes(image) / (1024.0 * 1024.0);
+            upload(image);
+            uploadSeconds += secondsSince(uploadStart);
+        }
+
+        std::cout << "STARTUP::TEXTURES:: " << count << " images (" << (int)uploadedMB << " MB) decoded and uploaded in "
+                  << secondsSince(start) * 1000.0 << " ms on " << pool.Size() << " threads; read+hash "
+                  << state.readSeconds * 1000.0 << " ms, GL upload " << uploadSeconds * 1000.0 << " ms" << std::endl;
+    }
+
+    // GL thread, once per frame: uploads streamed images whose decode has finished. Always uploads at least
+    // one if any is waiting, then keeps going until the deadline.
+    static void Update(Clock::time_point deadline)
+    {
+        Stream &state = stream();
+        do
+        {
+            PendingImage image;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.decoded.empty())
+                    return;
+                image = std::move(state.decoded.front());
+                state.decoded.pop_front();
+            }
+            upload(image);
+        } while (Clock::now() < deadline);
+    }
+
+    // false while a streamed or batched texture is still waiting for its pixels
+    static bool IsResident(unsigned int id)
+    {
+        auto it = entries().find(id);
+        return it == entries().end() || it->second.resident;
+    }
+
+    // the file reading and hashing half of Acquire; touches no shared state, so any thread may call these
+    static bool ReadFile(const std::string &path, std::vector<unsigned char> &bytes)
+    {
+        return readFile(path, bytes);
+    }
+
+    static uint64_t HashContents(const std::vector<unsigned char> &bytes, bool gammaCorrection, bool normalMap = false)
+    {
+        return hashBytes(bytes.data(), bytes.size(), normalMap ? 0x2D4E4Dull : (gammaCorrection ? 0x2D5247ull : 0x2D4C49ull));
+    }
+
+    // drops one reference; the texture stays resident until it is evicted
+    static void Release(unsigned int id)
+    {
+        auto it = entries().find(id);
+        if (it != entries().end() && it->second.refCount > 0)
+            it->second.refCount--;
+    }
+
+    // deletes the texture right away, whether or not it is still referenced
+    static void Evict(unsigned int id)
+    {
+        auto it = entries().find(id);
+        if (it == entries().end())
+            return;
+        for (const std::string &pathKey : it->second.pathKeys)
+            byPath().erase(pathKey);
+        byContent().erase(it->second.contentKey);
+        glDeleteTextures(1, &id);
+        entries().erase(it);
+    }
+
+    // Evict, but only if nothing references the texture anymore
+    static bool EvictIfUnused(unsigned int id)
+    {
+        auto it = entries().find(id);
+        if (it == entries().end() || it->second.refCount > 0)
+            return false;
+        Evict(id);
+        return true;
+    }
+
+    // deletes every texture that has no references left, returns how many were freed
+    static unsigned int EvictUnused()
+    {
+        std::vector<unsigned int> unused;
+        for (const auto &entry : entries())
+            if (entry.second.refCount == 0)
+                unused.push_back(entry.first);
+        for (unsigned int id : unused)
+            Evict(id);
+        return (unsigned int)unused.size();
+    }
+
+    static unsigned int Size()
+    {
+        return (unsigned int)entries().size();
+    }
+
+private:
+    enum QueueMode
+    {
+        Queue_Inline,   // decode and upload right away
+        Queue_Batch,    // wait for EndBatch
+        Queue_Stream    // decode on the pool now, upload in Update
+    };
+
+    // a file read on the GL thread, waiting to be decoded (any thread) and uploaded (GL thread)
+    struct PendingImage
+    {
+        unsigned int id;
+        GLenum target;
+        bool gammaCorrection;
+        bool normalMap = false;
+        bool s3tc = false, s3tcSrgb = false; // what the GL context can sample, looked up on the GL thread
+        uint64_t contentKey = 0;
+        std::string path;
+        std::vector<unsigned char> bytes;
+        unsigned char *pixels = nullptr;
+        int width = 0, height = 0, components = 0;
+        KtxImage compressed;                 // set instead of pixels when the image is uploaded block compressed
+    };
+
+    struct Batch
+    {
+        bool active = false;
+        double readSeconds = 0.0;
+        std::vector<PendingImage> images;
+    };
+
+    struct Stream
+    {
+        std::mutex mutex;
+        std::deque<PendingImage> decoded;
+    };
+
+    struct Entry
+    {
+        bool resident;
+        unsigned int refCount;
+        uint64_t contentKey;
+        std::vector<std::string> pathKeys;
+    };
+
+    static std::unordered_map<unsigned int, Entry> &entries()
+    {
+        static std::unordered_map<unsigned int, Entry> map;
+        return map;
+    }
+    static std::unordered_map<std::string, unsigned int> &byPath()
+    {
+        static std::unordered_map<std::string, unsigned int> map;
+        return map;
+    }
+    static std::unordered_map<uint64_t, unsigned int> &byContent()
+    {
+        static std::unordered_map<uint64_t, unsigned int> map;
+        return map;
+    }
+
+    static Batch &batch()
+    {
+        static Batch state;
+        return state;
+    }
+
+    static Stream &stream()
+    {
+        static Stream state;
+        return state;
+    }
+
+    static unsigned int create2D(const std::string &path, const std::string &pathKey, uint64_t contentKey, bool gammaCorrection,
+                                 bool normalMap, std::vector<unsigned char> &bytes, QueueMode mode)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        insert(textureID, pathKey, contentKey);
+
+        PendingImage image;
+        image.id = textureID;
+        image.target = GL_TEXTURE_2D;
+        image.gammaCorrection = gammaCorrection;
+        image.normalMap = normalMap;
+        image.s3tc = hasExtension("GL_EXT_texture_compression_s3tc");
+        image.s3tcSrgb = image.s3tc && hasExtension("GL_EXT_texture_sRGB");
+        image.contentKey = contentKey;
+        image.path = path;
+        image.bytes.swap(bytes);
+        enqueue(image, mode);
+        return textureID;
+    }
+
+    static double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    static void enqueue(PendingImage &image, QueueMode mode)
+    {
+        if (mode == Queue_Batch)
+        {
+            batch().images.push_back(std::move(image));
+        }
+        else if (mode == Queue_Stream)
+        {
+            ThreadPool::Shared().Submit([image = std::move(image)]() mutable {
+                decode(image);
+                std::lock_guard<std::mutex> lock(stream().mutex);
+                stream().decoded.push_back(std::move(image));
+            });
+        }
+        else
+        {
+            decode(image);
+            upload(image);
+        }
+    }
+
+    // CPU only, safe to run on a worker thread
+    static void decode(PendingImage &image)
+    {
+        // one file per way the image is loaded, each variant is keyed (and compressed) differently
+        std::string ktxPath = image.path + ktxSuffix(image.gammaCorrection, image.normalMap);
+        if (image.target == GL_TEXTURE_2D && KtxFile::Load(ktxPath, image.contentKey, image.compressed)
+            && formatUsable(image.compressed.glInternalFormat, image))
+        {
+            std::vector<unsigned char>().swap(image.bytes);
+            return;
+        }
+        image.compressed = KtxImage();
+
+        if (!image.bytes.empty())
+            image.pixels = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &image.width, &image.height, &image.components, 0);
+        std::vector<unsigned char>().swap(image.bytes);
+        if (!image.pixels || image.target != GL_TEXTURE_2D || image.width % 4 != 0 || image.height % 4 != 0)
+            return;
+
+        // first load of this image: encode it with all its mips and keep the result for the next run
+        BlockFormat format = TextureCompressor::ChooseFormat(image.pixels, image.width, image.height, image.components, image.normalMap);
+        CompressedTexture encoded;
+        encoded.format = format;
+        encoded.srgb = image.gammaCorrection;
+        if (!formatUsable(internalFormat(encoded), image))
+            return;
+        TextureCompressor::Compress(image.pixels, image.width, image.height, image.components, format, image.gammaCorrection, encoded);
+
+        image.compressed.glInternalFormat = internalFormat(encoded);
+        image.compressed.glBaseInternalFormat = format == Block_BC4 ? GL_RED : (format == Block_BC5 ? GL_RG : (format == Block_BC1 ? GL_RGB : GL_RGBA));
+        image.compressed.width = (uint32_t)image.width;
+        image.compressed.height = (uint32_t)image.height;
+        image.compressed.levels.swap(encoded.levels);
+        if (!KtxFile::Save(ktxPath, image.compressed, image.contentKey))
+            std::cout << "Texture cache could not be written at path: " << ktxPath << std::endl;
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+    }
+
+    static GLenum internalFormat(const CompressedTexture &texture)
+    {
+        switch (texture.format)
+        {
+        case Block_BC1: return texture.srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case Block_BC3: return texture.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case Block_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case Block_BC5: return GL_COMPRESSED_RG_RGTC2;
+        }
+        return 0;
+    }
+
+    // RGTC is core since 3.0, S3TC depends on the driver
+    static bool formatUsable(GLenum format, const PendingImage &image)
+    {
+        switch (format)
+        {
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2:
+            return true;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return image.s3tc;
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return image.s3tcSrgb;
+        }
+        return false;
+    }
+
+    // GL thread only; the extension list is read once
+    static bool hasExtension(const char *name)
+    {
+        static std::vector<std::string> extensions;
+        if (extensions.empty())
+        {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+                extensions.push_back((const char*)glGetStringi(GL_EXTENSIONS, i));
+        }
+        for (const std::string &extension : extensions)
+            if (extension == name)
+                return true;
+        return false;
+    }
+
+    static const char *keySuffix(bool gammaCorrection, bool normalMap)
+    {
+        return normalMap ? "#normal" : (gammaCorrection ? "#srgb" : "#linear");
+    }
+
+    static const char *ktxSuffix(bool gammaCorrection, bool normalMap)
+    {
+        return normalMap ? ".normal.ktx" : (gammaCorrection ? ".srgb.ktx" : ".linear.ktx");
+    }
+
+    static double uploadBytes(const PendingImage &image)
+    {
+        if (!image.compressed.levels.empty())
+        {
+            double bytes = 0.0;
+            for (const std::vector<unsigned char> &level : image.compressed.levels)
+                bytes += level.size();
+            return bytes;
+        }
+        return (double)image.width * image.height * image.components;
+    }
+
+    // GL thread only
+    static void upload(PendingImage &image)
+    {
+        auto entry = entries().find(image.id);
+        if (entry != entries().end())
+            entry->second.resident = true;
+        if (!image.compressed.levels.empty())
+        {
+            glBindTexture(GL_TEXTURE_2D, image.id);
+            for (unsigned int level = 0; level < image.compressed.levels.size(); level++)
+            {
+                const std::vector<unsigned char> &data = image.compressed.levels[level];
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, image.compressed.glInternalFormat,
+                                       std::max(1u, image.compressed.width >> level), std::max(1u, image.compressed.height >> level),
+                                       0, (GLsizei)data.size(), data.data());
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.compressed.levels.size() - 1);
+            image.compressed = KtxImage();
+            return;
+        }
+        if (!image.pixels)
+        {
+            if (image.target == GL_TEXTURE_2D)
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            else
+                std::cout << "Cubemap tex failed to load at path: " << image.path << std::endl;
+            return;
+        }
+
+        if (image.target == GL_TEXTURE_2D)
+        {
+            GLenum internalFormat = GL_RGB;
+            GLenum dataFormat = GL_RGB;
+            if (image.components == 1)
+            {
+                internalFormat = dataFormat = GL_RED;
+            }
+            else if (image.components == 3)
+            {
+                internalFormat = image.gammaCorrection ? GL_SRGB : GL_RGB;
+                dataFormat = GL_RGB;
+            }
+            else if (image.components == 4)
+            {
+                internalFormat = image.gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
+                dataFormat = GL_RGBA;
+            }
+            glBindTexture(GL_TEXTURE_2D, image.id);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, dataFormat, GL_UNSIGNED_BYTE, image.pixels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, image.id);
+            glTexImage2D(image.target, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+        }
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+    }
+
+    static unsigned int lookupPath(const std::string &pathKey)
+    {
+        auto it = byPath().find(pathKey);
+        if (it == byPath().end())
+            return 0;
+        entries()[it->second].refCount++;
+        return it->second;
+    }
+
+    // same bytes under a new path: remember the path so the next load of it skips reading the file
+    static unsigned int lookupContent(uint64_t contentKey, const std::string &pathKey)
+    {
+        auto it = byContent().find(contentKey);
+        if (it == byContent().end())
+            return 0;
+        Entry &entry = entries()[it->second];
+        entry.refCount++;
+        entry.pathKeys.push_back(pathKey);
+        byPath()[pathKey] = it->second;
+        return it->second;
+    }
+
+    static void insert(unsigned int id, const std::string &pathKey, uint64_t contentKey)
+    {
+        Entry entry;
+        entry.resident = false;
+        entry.refCount = 1;
+        entry.contentKey = contentKey;
+        entry.pathKeys.push_back(pathKey);
+        entries()[id] = entry;
+        byPath()[pathKey] = id;
+        byContent()[contentKey] = id;
+    }
+
+    static bool readFile(const std::string &path, std::vector<unsigned char> &bytes)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+        std::streamsize size = in.tellg();
+        if (size <= 0)
+            return false;
+        bytes.resize((size_t)size);
+        in.seekg(0);
+        return (bool)in.read((char *)bytes.data(), size);
+    }
+
+    // 64-bit FNV-1a, seeded so the same image loaded as sRGB and as linear gets two entries
+    static uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t seed)
+    {
+        uint64_t hash = 14695981039346656037ull ^ seed;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+#endif
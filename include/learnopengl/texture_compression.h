@@ -0,0 +1,430 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// CPU block compressor for the formats every GL 3.3 desktop GPU samples natively:
+//  BC1 (DXT1)  opaque color, 4 bpp
+//  BC3 (DXT5)  color with alpha, 8 bpp
+//  BC4 (RGTC1) single channel (height/roughness maps), 4 bpp
+//  BC5 (RGTC2) two channels, used for tangent space normal maps (z is rebuilt in the shader), 8 bpp
+// Compress() builds the whole mip chain on the CPU and encodes every level. There are no GL calls in
+// here, so it runs on worker threads and in headless tools alike.
+enum BlockFormat
+{
+    Block_BC1,
+    Block_BC3,
+    Block_BC4,
+    Block_BC5
+};
+
+// a compressed image with its mip chain; level i is max(1, width >> i) by max(1, height >> i) texels
+struct CompressedTexture
+{
+    BlockFormat format = Block_BC1;
+    bool srgb = false;
+    int width = 0, height = 0;
+    std::vector<std::vector<unsigned char>> levels;
+
+    size_t Bytes() const
+    {
+        size_t bytes = 0;
+        for (const std::vector<unsigned char> &level : levels)
+            bytes += level.size();
+        return bytes;
+    }
+};
+
+class TextureCompressor
+{
+public:
+    static unsigned int BlockBytes(BlockFormat format)
+    {
+        return (format == Block_BC1 || format == Block_BC4) ? 8 : 16;
+    }
+
+    // the natural format of a decoded stb_image result: BC5 for normal maps, BC4 for grey images,
+    // BC3 if any texel is not fully opaque and BC1 otherwise
+    static BlockFormat ChooseFormat(const unsigned char *pixels, int width, int height, int components, bool normalMap)
+    {
+        if (normalMap)
+            return Block_BC5;
+        if (components == 1)
+            return Block_BC4;
+        if (components == 2 || components == 4)
+        {
+            size_t count = (size_t)width * height;
+            for (size_t i = 0; i < count; i++)
+                if (pixels[i * components + components - 1] != 255)
+                    return Block_BC3;
+        }
+        return Block_BC1;
+    }
+
+    // compresses an 8-bit image with 1-4 channels (stb_image layout) including all mip levels. With srgb set
+    // the mips are filtered in linear space; normal maps are renormalized on every level.
+    static void Compress(const unsigned char *pixels, int width, int height, int components, BlockFormat format,
+                         bool srgb, CompressedTexture &out)
+    {
+        out.format = format;
+        out.srgb = srgb && (format == Block_BC1 || format == Block_BC3);
+        out.width = width;
+        out.height = height;
+        out.levels.clear();
+
+        // everything is filtered as RGBA8; grey images keep their value in r, grey+alpha becomes (g, g, g, a)
+        std::vector<unsigned char> level((size_t)width * height * 4);
+        for (size_t i = 0, count = (size_t)width * height; i < count; i++)
+        {
+            const unsigned char *src = pixels + i * components;
+            unsigned char *dst = &level[i * 4];
+            dst[0] = src[0];
+            dst[1] = components >= 3 ? src[1] : src[0];
+            dst[2] = components >= 3 ? src[2] : src[0];
+            dst[3] = components == 4 ? src[3] : (components == 2 ? src[1] : 255);
+        }
+
+        int levelWidth = width, levelHeight = height;
+        for (;;)
+        {
+            out.levels.push_back(encodeLevel(level.data(), levelWidth, levelHeight, format));
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+            level = downsample(level, levelWidth, levelHeight, out.srgb, format == Block_BC5);
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+    }
+
+    // rgba: 16 texels, row by row. Always uses the four color mode, so it is also the color half of BC3.
+    static void EncodeBC1(const unsigned char *rgba, unsigned char *out)
+    {
+        float colors[16][3];
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                colors[i][c] = rgba[i * 4 + c];
+                mean[c] += colors[i][c] / 16.0f;
+            }
+        }
+
+        // principal axis of the block colors (power iteration on the covariance matrix)
+        float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++)
+        {
+            float r = colors[i][0] - mean[0], g = colors[i][1] - mean[1], b = colors[i][2] - mean[2];
+            covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+            covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+        }
+        float axis[3] = {0.9f, 1.0f, 0.7f};
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+        }
+
+        // endpoints at the extreme projections, pulled in a little as the palette interpolates between them
+        int minIndex = 0, maxIndex = 0;
+        float minDot = 1e30f, maxDot = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float d = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+            if (d < minDot) { minDot = d; minIndex = i; }
+            if (d > maxDot) { maxDot = d; maxIndex = i; }
+        }
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++)
+        {
+            float inset = (colors[maxIndex][c] - colors[minIndex][c]) / 16.0f;
+            high[c] = colors[maxIndex][c] - inset;
+            low[c] = colors[minIndex][c] + inset;
+        }
+
+        uint16_t c0 = to565(high), c1 = to565(low);
+        uint32_t indices = 0;
+        float error = bc1Indices(colors, c0, c1, indices);
+
+        // one least squares refit of the endpoints against the chosen indices
+        float refitHigh[3], refitLow[3];
+        if (refitEndpoints(colors, indices, c0, c1, refitHigh, refitLow))
+        {
+            uint16_t r0 = to565(refitHigh), r1 = to565(refitLow);
+            uint32_t refitIndices = 0;
+            if (bc1Indices(colors, r0, r1, refitIndices) < error)
+            {
+                c0 = r0;
+                c1 = r1;
+                indices = refitIndices;
+            }
+        }
+
+        // the four color mode needs c0 > c1; swapping the endpoints mirrors the palette (0<->1, 2<->3)
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+            indices ^= 0x55555555u;
+        }
+        else if (c0 == c1)
+        {
+            indices = 0;
+        }
+        out[0] = (unsigned char)(c0 & 0xFF);
+        out[1] = (unsigned char)(c0 >> 8);
+        out[2] = (unsigned char)(c1 & 0xFF);
+        out[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)((indices >> (8 * i)) & 0xFF);
+    }
+
+    // values: 16 single channel texels, row by row. Uses the eight value mode (a0 > a1).
+    static void EncodeBC4(const unsigned char *values, unsigned char *out)
+    {
+        unsigned char low = 255, high = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+        }
+        out[0] = high;
+        out[1] = low;
+
+        uint64_t bits = 0;
+        if (high != low)
+        {
+            int palette[8];
+            palette[0] = high;
+            palette[1] = low;
+            for (int i = 2; i < 8; i++)
+                palette[i] = ((8 - i) * high + (i - 1) * low) / 7;
+            for (int t = 0; t < 16; t++)
+            {
+                int best = 0, bestError = 256;
+                for (int i = 0; i < 8; i++)
+                {
+                    int e = std::abs(palette[i] - (int)values[t]);
+                    if (e < bestError) { bestError = e; best = i; }
+                }
+                bits |= (uint64_t)best << (3 * t);
+            }
+        }
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xFF);
+    }
+
+private:
+    static std::vector<unsigned char> encodeLevel(const unsigned char *rgba, int width, int height, BlockFormat format)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned int blockBytes = BlockBytes(format);
+        std::vector<unsigned char> encoded((size_t)blocksX * blocksY * blockBytes);
+        unsigned char block[64], channel[16];
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                // blocks hanging over the edge of small levels repeat the last row/column
+                for (int y = 0; y < 4; y++)
+                {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                }
+
+                unsigned char *out = &encoded[((size_t)by * blocksX + bx) * blockBytes];
+                switch (format)
+                {
+                case Block_BC1:
+                    EncodeBC1(block, out);
+                    break;
+                case Block_BC3:
+                    gather(block, 3, channel);
+                    EncodeBC4(channel, out);
+                    EncodeBC1(block, out + 8);
+                    break;
+                case Block_BC4:
+                    gather(block, 0, channel);
+                    EncodeBC4(channel, out);
+                    break;
+                case Block_BC5:
+                    gather(block, 0, channel);
+                    EncodeBC4(channel, out);
+                    gather(block, 1, channel);
+                    EncodeBC4(channel, out + 8);
+                    break;
+                }
+            }
+        }
+        return encoded;
+    }
+
+    static void gather(const unsigned char *block, int component, unsigned char *channel)
+    {
+        for (int i = 0; i < 16; i++)
+            channel[i] = block[i * 4 + component];
+    }
+
+    // 2x2 box filter; odd sizes clamp the second tap
+    static std::vector<unsigned char> downsample(const std::vector<unsigned char> &src, int width, int height, bool srgb, bool normalMap)
+    {
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        std::vector<unsigned char> dst((size_t)w * h * 4);
+        const float *toLinear = srgbToLinearTable();
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                const unsigned char *taps[4] = {
+                    &src[((size_t)y0 * width + x0) * 4], &src[((size_t)y0 * width + x1) * 4],
+                    &src[((size_t)y1 * width + x0) * 4], &src[((size_t)y1 * width + x1) * 4]
+                };
+                float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for (int t = 0; t < 4; t++)
+                {
+                    for (int c = 0; c < 4; c++)
+                    {
+                        if (normalMap && c < 3)
+                            sum[c] += taps[t][c] / 127.5f - 1.0f;
+                        else if (srgb && c < 3)
+                            sum[c] += toLinear[taps[t][c]];
+                        else
+                            sum[c] += taps[t][c] / 255.0f;
+                    }
+                }
+                unsigned char *out = &dst[((size_t)y * w + x) * 4];
+                if (normalMap)
+                {
+                    float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                    if (length < 1e-6f) { sum[0] = 0.0f; sum[1] = 0.0f; sum[2] = 1.0f; length = 1.0f; }
+                    for (int c = 0; c < 3; c++)
+                        out[c] = toByte((sum[c] / length) * 0.5f + 0.5f);
+                }
+                else
+                {
+                    for (int c = 0; c < 3; c++)
+                        out[c] = toByte(srgb ? linearToSrgb(sum[c] / 4.0f) : sum[c] / 4.0f);
+                }
+                out[3] = toByte(sum[3] / 4.0f);
+            }
+        }
+        return dst;
+    }
+
+    static unsigned char toByte(float value)
+    {
+        return (unsigned char)std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f));
+    }
+
+    static const float *srgbToLinearTable()
+    {
+        // built once by whichever worker gets here first (static initialization is thread safe)
+        struct Table
+        {
+            float values[256];
+            Table()
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    float c = i / 255.0f;
+                    values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+            }
+        };
+        static const Table table;
+        return table.values;
+    }
+
+    static float linearToSrgb(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    static uint16_t to565(const float *color)
+    {
+        int r = (int)std::min(31.0f, std::max(0.0f, color[0] * 31.0f / 255.0f + 0.5f));
+        int g = (int)std::min(63.0f, std::max(0.0f, color[1] * 63.0f / 255.0f + 0.5f));
+        int b = (int)std::min(31.0f, std::max(0.0f, color[2] * 31.0f / 255.0f + 0.5f));
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(uint16_t color, float *out)
+    {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        out[0] = (float)((r << 3) | (r >> 2));
+        out[1] = (float)((g << 2) | (g >> 4));
+        out[2] = (float)((b << 3) | (b >> 2));
+    }
+
+    // picks the nearest of the four palette entries for every texel, returns the squared error
+    static float bc1Indices(const float colors[16][3], uint16_t c0, uint16_t c1, uint32_t &indices)
+    {
+        float palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        float total = 0.0f;
+        indices = 0;
+        for (int t = 0; t < 16; t++)
+        {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int i = 0; i < 4; i++)
+            {
+                float dr = colors[t][0] - palette[i][0], dg = colors[t][1] - palette[i][1], db = colors[t][2] - palette[i][2];
+                float e = dr * dr + dg * dg + db * db;
+                if (e < bestError) { bestError = e; best = i; }
+            }
+            indices |= (uint32_t)best << (2 * t);
+            total += bestError;
+        }
+        return total;
+    }
+
+    // solves for the two endpoints that minimize the error of the given palette indices
+    static bool refitEndpoints(const float colors[16][3], uint32_t indices, uint16_t c0, uint16_t c1, float *high, float *low)
+    {
+        static const float weight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+        for (int t = 0; t < 16; t++)
+        {
+            float a = weight[(indices >> (2 * t)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int c = 0; c < 3; c++)
+            {
+                ax[c] += a * colors[t][c];
+                bx[c] += b * colors[t][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f || c0 == c1)
+            return false;
+        for (int c = 0; c < 3; c++)
+        {
+            high[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            low[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+        return true;
+    }
+};
+
+#endif
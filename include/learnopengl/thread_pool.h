@@ -0,0 +1,143 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for CPU-only work (image decoding, mesh processing...).
+// Tasks must never touch OpenGL: the context is current on the main thread only.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // blocks until every task submitted so far has finished
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return pending == 0; });
+    }
+
+    // runs body(i) for i in [0, count) spread over the pool and the calling thread, returns once all
+    // calls are done. Waits for this loop only, not for other tasks in the pool, and since the caller
+    // works through the indices too it finishes even when every worker is busy (or it runs on a worker).
+    void ParallelFor(unsigned int count, const std::function<void(unsigned int)> &body)
+    {
+        if (count == 0)
+            return;
+        // shared with the tasks, which may start after the loop is over and find nothing left to do
+        auto loop = std::make_shared<Loop>();
+        loop->count = count;
+        loop->body = body;
+        unsigned int helpers = std::min(count - 1, Size());
+        for (unsigned int j = 0; j < helpers; j++)
+            Submit([loop]() { loop->Run(); });
+        loop->Run();
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->finished.wait(lock, [&loop]() { return loop->done == loop->count; });
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    // pool shared by the whole program, one thread per core
+    static ThreadPool &Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    // one ParallelFor call
+    struct Loop
+    {
+        std::function<void(unsigned int)> body;
+        unsigned int count = 0;
+        std::atomic<unsigned int> next{0};
+        unsigned int done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+
+        void Run()
+        {
+            unsigned int ran = 0;
+            for (unsigned int i = next++; i < count; i = next++, ran++)
+                body(i);
+            if (ran == 0)
+                return;
+            std::lock_guard<std::mutex> lock(mutex);
+            done += ran;
+            if (done == count)
+                finished.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    unsigned int pending = 0;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+// Binding points of the uniform blocks the shaders in resources/shaders share. GLSL 330 can't give a
+// block its binding in the source, so every Shader binds the blocks it declares right after linking.
+enum UniformBlockBinding
+{
+    CAMERA_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1,
+    CLUSTERS_BLOCK_BINDING = 2,
+    SHADOWS_BLOCK_BINDING = 3
+};
+
+// binds each shared block the program declares to its binding point; blocks it doesn't use are skipped
+inline void bindUniformBlocks(unsigned int program)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned int binding;
+    } blocks[] = {
+        {"Camera", CAMERA_BLOCK_BINDING},
+        {"Lights", LIGHTS_BLOCK_BINDING},
+        {"Clusters", CLUSTERS_BLOCK_BINDING},
+        {"Shadows", SHADOWS_BLOCK_BINDING}
+    };
+    for (const auto &block : blocks)
+    {
+        unsigned int index = glGetUniformBlockIndex(program, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, block.binding);
+    }
+}
+
+// A uniform buffer holding one std140 block, bound to its binding point for the lifetime of the object.
+// T is the C++ mirror of the block and has to follow the std140 rules itself (a vec3 takes a 16 byte
+// slot unless a float follows it, arrays and structs start on 16 bytes). Upload replaces the whole
+// block with one glBufferSubData, so every program reading it sees the new values on its next draw.
+template <typename T>
+class UniformBuffer
+{
+public:
+    explicit UniformBuffer(UniformBlockBinding binding)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void Upload(const T &block)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    unsigned int ID = 0;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef UNIFORM_HANDLE_H
+#define UNIFORM_HANDLE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+
+// the glUniform* call matching each C++ type a UniformHandle can carry
+inline void setUniform(int location, bool value)             { glUniform1i(location, (int)value); }
+inline void setUniform(int location, int value)              { glUniform1i(location, value); }
+inline void setUniform(int location, float value)            { glUniform1f(location, value); }
+inline void setUniform(int location, const glm::vec2 &value) { glUniform2fv(location, 1, &value[0]); }
+inline void setUniform(int location, const glm::vec3 &value) { glUniform3fv(location, 1, &value[0]); }
+inline void setUniform(int location, const glm::vec4 &value) { glUniform4fv(location, 1, &value[0]); }
+inline void setUniform(int location, const glm::mat3 &value) { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+inline void setUniform(int location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+
+// A uniform location resolved once (Shader::getUniform<T>) and then set without any string work or
+// driver query. Like the Shader::set* functions it writes to the program currently in use. A handle
+// to a uniform the program doesn't have (location -1) is valid and setting it does nothing.
+template <typename T>
+class UniformHandle
+{
+public:
+    UniformHandle() : location(-1) {}
+    explicit UniformHandle(int location) : location(location) {}
+
+    void set(const T &value) const
+    {
+        setUniform(location, value);
+    }
+
+    bool valid() const
+    {
+        return location >= 0;
+    }
+
+    int location;
+};
+
+// name -> location of every active uniform of a linked program, filled once right after linking.
+// Array uniforms are listed both as "name[0]" (what the driver reports) and as "name".
+inline std::unordered_map<std::string, int> reflectUniforms(unsigned int program)
+{
+    std::unordered_map<std::string, int> locations;
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::string name(maxLength > 0 ? maxLength : 1, '\0');
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+        std::string uniform(name.data(), length);
+        int location = glGetUniformLocation(program, uniform.c_str());
+        if (location < 0)
+            continue; // lives in a uniform block
+        locations[uniform] = location;
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+            locations[uniform.substr(0, uniform.size() - 3)] = location;
+    }
+    return locations;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef VEGETATION_H
+#define VEGETATION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <random>
+#include <vector>
+
+// Alpha tested billboard vegetation (grass blades). Every blade is one vec4 in a per-instance vertex
+// buffer, position in xyz and rotation about the y axis (radians) in w, and the whole field is drawn
+// with a single glDrawArraysInstanced through blending_instanced.vs. The CPU only touches the blades
+// when they are added, so the per-frame cost is one draw call however many blades there are.
+class Vegetation
+{
+public:
+    // width of a blade's quad; its height is the same, centered on the blade position
+    float bladeScale;
+
+    explicit Vegetation(float bladeScale = 100.0f)
+        : bladeScale(bladeScale)
+    {
+    }
+
+    Vegetation(const Vegetation&) = delete;
+    Vegetation& operator=(const Vegetation&) = delete;
+
+    ~Vegetation()
+    {
+        if (VAO != 0)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &quadVBO);
+            glDeleteBuffers(1, &instanceVBO);
+        }
+    }
+
+    void Add(const glm::vec3 &position, float rotationDegrees)
+    {
+        blades.push_back(glm::vec4(position, glm::radians(rotationDegrees)));
+        dirty = true;
+    }
+
+    // scatters count blades with random rotations over the rectangle [min.x, max.x] x [min.z, max.z] at height min.y
+    void Scatter(const glm::vec3 &min, const glm::vec3 &max, unsigned int count, unsigned int seed = 1)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> x(min.x, max.x), z(min.z, max.z), rotation(0.0f, 180.0f);
+        blades.reserve(blades.size() + count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float bladeX = x(random), bladeZ = z(random);
+            Add(glm::vec3(bladeX, min.y, bladeZ), rotation(random));
+        }
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)blades.size();
+    }
+
+    // binds nothing but the VAO: the caller sets up the shader, view/projection and the blade texture
+    void Draw(Shader &shader)
+    {
+        if (blades.empty())
+            return;
+        if (VAO == 0)
+            setup();
+        if (dirty)
+            upload();
+        shader.setFloat("bladeScale", bladeScale);
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)blades.size());
+        glBindVertexArray(0);
+    }
+
+private:
+    std::vector<glm::vec4> blades;
+    bool dirty = false;
+    unsigned int VAO = 0, quadVBO = 0, instanceVBO = 0;
+
+    void setup()
+    {
+        // one blade quad, pivot on its left edge like the original grass quads
+        float quadVertices[] = {
+                // positions         // texture Coords
+                0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
+                0.0f, -0.5f,  0.0f,  0.0f,  1.0f,
+                1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
+
+                0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
+                1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
+                1.0f,  0.5f,  0.0f,  1.0f,  0.0f
+        };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+
+        // per blade: position and rotation
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+    }
+
+    void upload()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, blades.size() * sizeof(glm::vec4), blades.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        dirty = false;
+    }
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include <vector>
 #include <string>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
 #include <rg/mesh.h>
 
 #include <assimp/Importer.hpp>
@@ -17,6 +18,7 @@
 class Model {
 public:
     std::vector<Mesh> meshes;
+    // one entry per TextureCache::Acquire, released in ~Model
     std::vector<Texture> loaded_textures;
 
     std::string directory;
@@ -25,6 +27,15 @@ public:
         loadModel(path);
     }
 
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    ~Model() {
+        for (Texture& texture : loaded_textures) {
+            TextureCache::Release(texture.id);
+        }
+    }
+
     void Draw(Shader& shader) {
         for (Mesh& mesh : meshes) {
             mesh.Draw(shader);
@@ -123,24 +134,12 @@ private:
             aiString str;
             mat->GetTexture(type, i, &str);
 
-            bool skip = false;
-
-            for (unsigned int j = 0; j < loaded_textures.size(); ++j) {
-                if (std::strcmp(str.C_Str(), loaded_textures[j].path.c_str()) == 0) {
-                    textures.push_back(loaded_textures[j]);
-                    skip = true;
-                    break;
-                }
-            }
-
-            if (!skip) {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                loaded_textures.push_back(texture);
-            }
+            Texture texture;
+            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+            loaded_textures.push_back(texture);
         }
 
     }
@@ -149,33 +148,8 @@ private:
 unsigned int TextureFromFile(const char* filename, std::string directory) {
     std::string fullPath(directory + "/" + filename);
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(fullPath.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1) {
-            format = GL_RED;
-        } else if (nrComponents == 3) {
-            format = GL_RGB;
-        } else if (nrComponents == 4) {
-            format = GL_RGBA;
-        }
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_FILTER, GL_LINEAR);
-
-    } else {
-        ASSERT(false, "Failed to load texture image");
-    }
-    stbi_image_free(data);
+    unsigned int textureID = TextureCache::Acquire(fullPath);
+    ASSERT(textureID != 0, "Failed to load texture image");
     return textureID;
 }
 
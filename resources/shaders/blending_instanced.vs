@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in vec4 aBlade; // xyz position, w rotation about y in radians
+
+out vec2 TexCoords;
+
+uniform float bladeScale;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+void main()
+{
+    TexCoords = aTexCoords;
+    // same as translate(position) * scale(bladeScale) * rotate(rotation, y) on the CPU
+    float s = sin(aBlade.w);
+    float c = cos(aBlade.w);
+    vec3 local = aPos * bladeScale;
+    vec3 world = aBlade.xyz + vec3(c * local.x + s * local.z, local.y, -s * local.x + c * local.z);
+    gl_Position = projection * view * vec4(world, 1.0);
+}
\ No newline at end of file
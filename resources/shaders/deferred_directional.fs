@@ -0,0 +1,59 @@
+#version 330 core
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    vec3 lightPos;
+    bool noc;
+};
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+uniform float shininess;
+
+#include "shadows.glsl"
+
+// same as CalcDirLight in model_lighting.fs, on the G-buffer
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 normal = texelFetch(gNormal, pixel, 0).rgb;
+    if (normal == vec3(0.0))
+        discard; // no model here, leave the pixel to the forward passes
+    vec3 fragPos = texelFetch(gPosition, pixel, 0).rgb;
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+
+    // at night the light volumes add everything on top of black
+    if (noc) {
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    vec3 lightDir = normalize(-dirLight.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = dirLight.ambient * albedoSpec.rgb;
+    vec3 diffuse = dirLight.diffuse * diff * albedoSpec.rgb;
+    vec3 specular = dirLight.specular * spec * albedoSpec.a;
+    FragColor = vec4(ambient + ShadowFactor(fragPos, normal) * (diffuse + specular), 1.0);
+}
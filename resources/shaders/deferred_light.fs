@@ -0,0 +1,93 @@
+#version 330 core
+out vec4 FragColor;
+
+// a spot or point light, fetched from lightData; point lights have a cone that covers every direction
+struct Light {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+flat in int lightIndex;
+flat in vec4 sphere;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+uniform samplerBuffer lightData; // 5 texels per light, see clustered_lights.h
+uniform float shininess;
+
+Light FetchLight(int index)
+{
+    int texel = index * 5;
+    vec4 positionConstant = texelFetch(lightData, texel);
+    vec4 directionCutOff = texelFetch(lightData, texel + 1);
+    vec4 ambientLinear = texelFetch(lightData, texel + 2);
+    vec4 diffuseQuadratic = texelFetch(lightData, texel + 3);
+    vec4 specularOuterCutOff = texelFetch(lightData, texel + 4);
+
+    Light light;
+    light.position = positionConstant.xyz;
+    light.constant = positionConstant.w;
+    light.direction = directionCutOff.xyz;
+    light.cutOff = directionCutOff.w;
+    light.ambient = ambientLinear.rgb;
+    light.linear = ambientLinear.w;
+    light.diffuse = diffuseQuadratic.rgb;
+    light.quadratic = diffuseQuadratic.w;
+    light.specular = specularOuterCutOff.rgb;
+    light.outerCutOff = specularOuterCutOff.w;
+    return light;
+}
+
+// same as CalcLight in model_lighting.fs, on the G-buffer
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 normal = texelFetch(gNormal, pixel, 0).rgb;
+    vec3 fragPos = texelFetch(gPosition, pixel, 0).rgb;
+    vec3 toSphere = fragPos - sphere.xyz;
+    if (normal == vec3(0.0) || dot(toSphere, toSphere) > sphere.w * sphere.w)
+        discard; // no model here, or the surface is outside the light's reach
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+    Light light = FetchLight(lightIndex);
+
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = light.ambient * albedoSpec.rgb;
+    vec3 diffuse = light.diffuse * diff * albedoSpec.rgb;
+    vec3 specular = light.specular * spec * albedoSpec.a;
+
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = (light.cutOff - light.outerCutOff);
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    diffuse  *= intensity;
+    specular *= intensity;
+
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+    FragColor = vec4((ambient + diffuse + specular) * attenuation, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aSphere; // center, radius
+
+flat out int lightIndex;
+flat out vec4 sphere;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// one instance per light, in the order of ClusteredLights::lights
+void main()
+{
+    lightIndex = gl_InstanceID;
+    sphere = aSphere;
+    gl_Position = projection * view * vec4(aSphere.xyz + aPos * aSphere.w, 1.0);
+}
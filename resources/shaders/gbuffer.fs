@@ -0,0 +1,42 @@
+#version 330 core
+layout (location = 0) out vec3 gPosition;
+layout (location = 1) out vec3 gNormal;
+layout (location = 2) out vec4 gAlbedoSpec;
+
+// with TEXTURE_ARRAYS the textures are layers of GL_TEXTURE_2D_ARRAYs (see texture_array.h)
+#ifdef TEXTURE_ARRAYS
+struct Material {
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+
+    float shininess;
+};
+// layer of the texture on each unit, texture_diffuse1 is on unit 0 and texture_specular1 on unit 2 (Material::Unit)
+uniform float textureLayers[8];
+#define SAMPLE_DIFFUSE(uv) texture(material.texture_diffuse1, vec3(uv, textureLayers[0]))
+#define SAMPLE_SPECULAR(uv) texture(material.texture_specular1, vec3(uv, textureLayers[2]))
+#else
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+
+    float shininess;
+};
+#define SAMPLE_DIFFUSE(uv) texture(material.texture_diffuse1, uv)
+#define SAMPLE_SPECULAR(uv) texture(material.texture_specular1, uv)
+#endif
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+
+uniform Material material;
+
+// geometry pass of the deferred path, behind model_lighting.vs / model_lighting_instanced.vs
+void main()
+{
+    gPosition = FragPos;
+    gNormal = normalize(Normal);
+    gAlbedoSpec.rgb = SAMPLE_DIFFUSE(TexCoords).rgb;
+    gAlbedoSpec.a = SAMPLE_SPECULAR(TexCoords).r;
+}
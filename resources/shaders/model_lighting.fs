@@ -1,7 +1,8 @@
 #version 330 core
 out vec4 FragColor;
 
-struct SpotLight {
+// a spot or point light, fetched from lightData; point lights have a cone that covers every direction
+struct Light {
     vec3 position;
     vec3 direction;
     float cutOff;
@@ -16,18 +17,6 @@ struct SpotLight {
     float quadratic;
 };
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
 struct DirLight {
     vec3 direction;
 
@@ -36,73 +25,94 @@ struct DirLight {
     vec3 specular;
 };
 
+// with TEXTURE_ARRAYS the textures are layers of GL_TEXTURE_2D_ARRAYs (see texture_array.h)
+#ifdef TEXTURE_ARRAYS
+struct Material {
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+
+    float shininess;
+};
+// layer of the texture on each unit, texture_diffuse1 is on unit 0 and texture_specular1 on unit 2 (Material::Unit)
+uniform float textureLayers[8];
+#define SAMPLE_DIFFUSE(uv) texture(material.texture_diffuse1, vec3(uv, textureLayers[0]))
+#define SAMPLE_SPECULAR(uv) texture(material.texture_specular1, vec3(uv, textureLayers[2]))
+#else
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
 
     float shininess;
 };
+#define SAMPLE_DIFFUSE(uv) texture(material.texture_diffuse1, uv)
+#define SAMPLE_SPECULAR(uv) texture(material.texture_specular1, uv)
+#endif
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform PointLight pointLight1;
-uniform PointLight pointLight2;
-uniform PointLight pointLight3;
-uniform PointLight pointLight4;
-uniform PointLight pointLight5;
-uniform PointLight pointLight6;
-uniform PointLight pointLight7;
-uniform PointLight pointLight8;
-uniform PointLight pointLight9;
-uniform PointLight pointLight10;
-uniform PointLight pointLight11;
-uniform PointLight pointLight12;
-uniform PointLight pointLight13;
-uniform PointLight pointLight14;
-uniform PointLight pointLight15;
-
 uniform Material material;
-uniform DirLight dirLight;
-
-uniform SpotLight spotlight1;
-uniform SpotLight spotlight2;
-uniform SpotLight spotlight3;
-uniform SpotLight spotlight4;
-uniform SpotLight spotlight5;
-uniform SpotLight spotlight6;
-uniform SpotLight spotlight7;
-uniform SpotLight spotlight8;
-uniform SpotLight spotlight9;
-
-uniform bool noc;
-uniform vec3 viewPosition;
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
 
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    vec3 lightPos;
+    bool noc;
+};
 
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+// clustered light lists, built by ClusteredLights every frame (see clustered_lights.h)
+layout (std140) uniform Clusters {
+    float sliceScale;
+    float sliceBias;
+    int gridX;
+    int gridY;
+    int gridZ;
+};
 
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+uniform samplerBuffer lightData;      // 5 texels per light
+uniform usamplerBuffer clusterLights; // offset and count into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
 
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
-
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+#include "shadows.glsl"
+
+Light FetchLight(int index)
+{
+    int texel = index * 5;
+    vec4 positionConstant = texelFetch(lightData, texel);
+    vec4 directionCutOff = texelFetch(lightData, texel + 1);
+    vec4 ambientLinear = texelFetch(lightData, texel + 2);
+    vec4 diffuseQuadratic = texelFetch(lightData, texel + 3);
+    vec4 specularOuterCutOff = texelFetch(lightData, texel + 4);
+
+    Light light;
+    light.position = positionConstant.xyz;
+    light.constant = positionConstant.w;
+    light.direction = directionCutOff.xyz;
+    light.cutOff = directionCutOff.w;
+    light.ambient = ambientLinear.rgb;
+    light.linear = ambientLinear.w;
+    light.diffuse = diffuseQuadratic.rgb;
+    light.quadratic = diffuseQuadratic.w;
+    light.specular = specularOuterCutOff.rgb;
+    light.outerCutOff = specularOuterCutOff.w;
+    return light;
+}
+
+// index of the cluster the fragment lies in, the same grid ClusteredLights bins into
+int ClusterIndex(vec3 fragPos)
+{
+    vec4 viewPos = view * vec4(fragPos, 1.0);
+    vec4 clipPos = projection * viewPos;
+    vec2 ndc = clipPos.xy / clipPos.w;
+    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(gridX, gridY)), ivec2(0), ivec2(gridX - 1, gridY - 1));
+    int slice = clamp(int(log(-viewPos.z) * sliceScale + sliceBias), 0, gridZ - 1);
+    return tile.x + gridX * (tile.y + gridY * slice);
 }
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
@@ -117,13 +127,14 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
+    vec3 ambient = light.ambient * vec3(SAMPLE_DIFFUSE(TexCoords));
+    vec3 diffuse = light.diffuse * diff * vec3(SAMPLE_DIFFUSE(TexCoords));
+    vec3 specular = light.specular * spec * vec3(SAMPLE_SPECULAR(TexCoords));
+    // the ambient term lights the shadows
+    return (ambient + ShadowFactor(FragPos, normal) * (diffuse + specular));
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
         vec3 lightDir = normalize(light.position - fragPos);
         // diffuse shading
@@ -132,9 +143,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
         vec3 halfwayDir = normalize(lightDir + viewDir);
         float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
         // combine results
-        vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-        vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-        vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
+        vec3 ambient = light.ambient * vec3(SAMPLE_DIFFUSE(TexCoords));
+        vec3 diffuse = light.diffuse * diff * vec3(SAMPLE_DIFFUSE(TexCoords));
+        vec3 specular = light.specular * spec * vec3(SAMPLE_SPECULAR(TexCoords).xxx);
 
         float theta = dot(lightDir, normalize(-light.direction));
         float epsilon = (light.cutOff - light.outerCutOff);
@@ -160,30 +171,11 @@ void main()
     vec3 result;
 
     if(noc){
-        // result = CalcSpotLight(spotlight1, normal, FragPos, viewDir);
-        result = CalcSpotLight(spotlight2, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight3, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight4, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight5, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight6, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight7, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight8, normal, FragPos, viewDir);
-        result += CalcSpotLight(spotlight9, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight1, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight2, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight3, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight4, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight5, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight6, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight7, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight8, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight9, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight10, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight11, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight12, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight13, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight14, normal, FragPos, viewDir);
-        result += CalcPointLight(pointLight15, normal, FragPos, viewDir);
+        // only the lights whose range reaches this fragment's cluster
+        uvec2 lights = texelFetch(clusterLights, ClusterIndex(FragPos)).rg;
+        result = vec3(0.0);
+        for(uint i = 0u; i < lights.y; i++)
+            result += CalcLight(FetchLight(int(texelFetch(lightIndices, int(lights.x + i)).r)), normal, FragPos, viewDir);
     }
     else{
         result = CalcDirLight(dirLight, normal, viewDir);
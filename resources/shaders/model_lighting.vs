@@ -1,6 +1,6 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec3 aPos;       // 0..1 across the mesh bounds, see PackedVertex
+layout (location = 1) in vec2 aNormal;    // octahedral
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
@@ -8,13 +8,31 @@ out vec3 Normal;
 out vec3 FragPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// bounds of the mesh the positions are quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// unfolds an octahedral encoded unit vector
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(model * vec4(positionOffset + aPos * positionScale, 1.0));
+    Normal = mat3(transpose(inverse(model))) * octahedralDecode(aNormal);
     TexCoords = aTexCoords;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
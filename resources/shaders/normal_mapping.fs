@@ -12,15 +12,14 @@ in VS_OUT {
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-
 void main()
 {
-     // obtain normal from normal map in range [0,1]
-    vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
-    // transform normal vector to range [-1,1]
-    normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
+     // obtain normal from the two channel (BC5) normal map in range [0,1]
+    vec3 normal;
+    // transform x and y to range [-1,1] and rebuild z, which always points out of the surface
+    normal.xy = texture(normalMap, fs_in.TexCoords).rg * 2.0 - 1.0;
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    normal = normalize(normal);  // this normal is in tangent space
 
     // get diffuse color
     vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
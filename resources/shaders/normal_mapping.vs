@@ -13,12 +13,27 @@ out VS_OUT {
     vec3 TangentFragPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    vec3 lightPos;
+    bool noc;
+};
 
 void main()
 {
@@ -33,7 +48,7 @@ void main()
 
     mat3 TBN = transpose(mat3(T, B, N));
     vs_out.TangentLightPos = TBN * lightPos;
-    vs_out.TangentViewPos  = TBN * viewPos;
+    vs_out.TangentViewPos  = TBN * viewPosition;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
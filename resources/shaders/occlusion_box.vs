@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // unit cube corner, 0 or 1 per axis
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+// the world space bounding box of one object, only drawn into an occlusion query
+void main()
+{
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
@@ -11,10 +11,51 @@ in VS_OUT {
 
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
-uniform sampler2D depthMap;
 
 uniform float heightScale;
 
+#ifdef CONE_STEP_MAPPING
+// relaxed cone step map (ConeStepMap): depth in r, square root of the cone ratio in g
+uniform sampler2D coneMap;
+
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    const int coneSteps = 12;
+    const int binarySteps = 6;
+    // the ray through the depth map: texture coordinates in xy, depth in z, one unit of depth per step of z
+    vec3 rayDir = vec3(-viewDir.xy / viewDir.z * heightScale, 1.0);
+    float rayRatio = length(rayDir.xy);
+    vec3 position = vec3(texCoords, 0.0);
+
+    // every step goes to where the ray leaves the cone under it: far while the ray is high above the
+    // surface, slowing down near it, and at most once across it (the cones are relaxed), after which
+    // the steps are 0
+    float lastStep = 0.0;
+    for (int i = 0; i < coneSteps; i++)
+    {
+        vec2 cone = texture(coneMap, position.xy).rg;
+        float ratio = cone.g * cone.g;
+        float advance = ratio * max(cone.r - position.z, 0.0) / (rayRatio + ratio);
+        position += rayDir * advance;
+        if (advance > 0.0)
+            lastStep = advance;
+    }
+
+    // the first hit is within the last step that moved
+    vec3 delta = rayDir * lastStep;
+    for (int i = 0; i < binarySteps; i++)
+    {
+        delta *= 0.5;
+        if (texture(coneMap, position.xy).r > position.z)
+            position += delta;
+        else
+            position -= delta;
+    }
+    return position.xy;
+}
+#else
+uniform sampler2D depthMap;
+
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 {
     // number of depth layers
@@ -56,6 +97,7 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 
     return finalTexCoords;
 }
+#endif
 
 void main()
 {
@@ -67,9 +109,11 @@ void main()
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
         discard;
 
-    // obtain normal from normal map
-    vec3 normal = texture(normalMap, texCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    // obtain normal from the two channel (BC5) normal map, z is rebuilt from x and y
+    vec3 normal;
+    normal.xy = texture(normalMap, texCoords).rg * 2.0 - 1.0;
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    normal = normalize(normal);
 
     // get diffuse color
     vec3 color = texture(diffuseMap, texCoords).rgb;
@@ -9,20 +9,31 @@ in vec3 FragPos;
 struct DirLight {
     vec3 direction;
 
-    vec3 ambientDay;
-    vec3 diffuseDay;
-    vec3 specularDay;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    vec3 lightPos;
+    bool noc;
+};
 
-    vec3 ambientNight;
-    vec3 diffuseNight;
-    vec3 specularNight;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
 };
 
 uniform sampler2D texture1;
 uniform float shininess;
-uniform DirLight dirLight;
-uniform vec3 viewPosition;
-uniform bool noc;
+
+#include "shadows.glsl"
+
+// the ground takes the direction from the shared sun but has a dimmer diffuse term of its own,
+// and at night only that diffuse term is left
+const vec3 groundDiffuse = vec3(0.1, 0.1, 0.1);
 
 vec3 CalcDirLightDay(DirLight light, vec3 normal, vec3 viewDir)
 {
@@ -33,24 +44,19 @@ vec3 CalcDirLightDay(DirLight light, vec3 normal, vec3 viewDir)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
 //     combine results
-    vec3 ambient = light.ambientDay * vec3(texture(texture1, TexCoords));
-    vec3 diffuse = light.diffuseDay * diff * vec3(texture(texture1, TexCoords));
-    vec3 specular = light.specularDay * spec * vec3(texture(texture1, TexCoords));
-    return (ambient + diffuse + specular);
+    vec3 ambient = light.ambient * vec3(texture(texture1, TexCoords));
+    vec3 diffuse = groundDiffuse * diff * vec3(texture(texture1, TexCoords));
+    vec3 specular = light.specular * spec * vec3(texture(texture1, TexCoords));
+    return (ambient + ShadowFactor(FragPos, normal) * (diffuse + specular));
 }
 vec3 CalcDirLightNight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
 //     combine results
-    vec3 ambient = light.ambientNight * vec3(texture(texture1, TexCoords));
-    vec3 diffuse = light.diffuseNight * diff * vec3(texture(texture1, TexCoords));
-    vec3 specular = light.specularNight * spec * vec3(texture(texture1, TexCoords));
-    return (ambient + diffuse + specular);
+    vec3 diffuse = groundDiffuse * diff * vec3(texture(texture1, TexCoords));
+    return diffuse;
 }
 
 
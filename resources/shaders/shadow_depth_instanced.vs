@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;       // 0..1 across the mesh bounds, see PackedVertex
+layout (location = 5) in mat4 aInstanceModel;
+
+// projection * view of the cascade being rendered
+uniform mat4 lightSpace;
+
+// bounds of the mesh the positions are quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    gl_Position = lightSpace * aInstanceModel * vec4(positionOffset + aPos * positionScale, 1.0);
+}
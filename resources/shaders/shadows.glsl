@@ -0,0 +1,37 @@
+// cascaded shadow maps of the directional light, rendered by CascadedShadowMaps (see shadow_maps.h);
+// #included by the shaders that light with the sun, after their Camera block and dirLight
+layout (std140) uniform Shadows {
+    mat4 lightSpace[4];
+    vec4 cascadeEnds;   // view depth where each cascade ends
+    vec4 texelSizes;    // world size of a shadow map texel in each cascade
+    int cascadeCount;   // 0: no shadows
+};
+
+uniform sampler2DArrayShadow shadowMap;
+
+// how much of the directional light reaches fragPos, 0 in full shadow
+float ShadowFactor(vec3 fragPos, vec3 normal)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && depth > cascadeEnds[cascade])
+        cascade++;
+    if (cascade >= cascadeCount)
+        return 1.0;
+
+    // pushed out along the normal, more the more the surface turns away from the light, so it doesn't
+    // shadow itself where the texels are coarse
+    float slope = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    vec3 offsetPos = fragPos + normal * texelSizes[cascade] * (0.5 + 1.5 * slope);
+    vec3 coords = (lightSpace[cascade] * vec4(offsetPos, 1.0)).xyz * 0.5 + 0.5;
+    // behind every caster still receives their shadows
+    coords.z = min(coords.z, 1.0);
+
+    // 3x3 PCF, each lookup itself filtered over 2x2 texels
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    return lit / 9.0;
+}
@@ -13,6 +13,19 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/vegetation.h>
+#include <learnopengl/uniform_buffer.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/deferred_renderer.h>
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/scene_bvh.h>
+#include <learnopengl/occlusion_culler.h>
+#include <learnopengl/lod_selector.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/shadow_maps.h>
+#include <learnopengl/cone_step_map.h>
+#include <learnopengl/fixed_timestep.h>
 
 #include <iostream>
 
@@ -26,15 +39,20 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 
 void processInput(GLFWwindow *window);
 
+void processMovement(GLFWwindow *window, float seconds);
+
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 
 unsigned int loadTexture(const char *path, bool gammaCorrection);
+unsigned int loadNormalMap(const char *path);
 
 void renderQuad();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 10000.0f;
 
 // camera
 float lastX = SCR_WIDTH / 2.0f;
@@ -42,12 +60,35 @@ float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
 float heightScale = 0.1;
+// procedurally placed grass blades along the road, all drawn with one instanced call
+const unsigned int ROADSIDE_GRASS_BLADES = 20000;
+// milliseconds per frame spent uploading streamed models and textures
+const double STREAMING_BUDGET_MS = 4.0;
+// seconds between the frame time reports of the forward/deferred comparison
+const double FRAME_REPORT_INTERVAL = 5.0;
+// how far the dodge's box in the scene BVH reaches past the car, so it is only reinserted every few frames
+const float DODGE_BVH_MARGIN = 50.0f;
+// simulation steps per second; the dodge and the camera move in fixed steps whatever the frame rate
+const double SIMULATION_RATE = 60.0;
+// the dodge drives from DODGE_START_Z to DODGE_END_Z and starts over, speeds in units per second
+const float DODGE_START_Z = 3685.0f;
+const float DODGE_END_Z = -4730.0f;
+const float DODGE_SPEED = 300.0f;
+const float CAMERA_SPEED = 300.0f;
 bool noc = false;
+// set by P, the main loop then reports the object in the middle of the screen
+bool pickRequested = false;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// what a simulation step advances, the frame draws a mix of the states before and after the last step
+struct SimulationState {
+    glm::vec3 cameraPosition;
+    float dodgeZ;
+};
+
 struct PointLight {
     glm::vec3 position;
     glm::vec3 ambient;
@@ -67,11 +108,48 @@ struct DirLight {
     glm::vec3 specular;
 };
 
+// std140 mirrors of the Camera and Lights uniform blocks declared in resources/shaders,
+// the member order and padding have to match the GLSL declarations exactly
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding;
+};
+
+struct DirLightBlock {
+    glm::vec3 direction;
+    float padding0;
+
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+
+struct LightsBlock {
+    DirLightBlock dirLight;
+    glm::vec3 lightPos; // light of the parallax and normal mapped quads
+    int noc;            // GLSL bool, 4 bytes in std140
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock has to match the std140 Camera block");
+static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock has to match the std140 DirLight struct");
+static_assert(sizeof(LightsBlock) == 80, "LightsBlock has to match the std140 Lights block");
+
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
+    bool deferredShading = false;
+    bool occlusionCulling = true;
+    bool levelsOfDetail = true;
+    bool shadows = true;
+    bool coneStepParallax = true;
+    bool vsync = true;
 
     glm::vec3 lampPosition = glm::vec3(562, 10, 3570);
     glm::vec3 ponyPosition = glm::vec3(-10, -0.3, -83);
@@ -186,6 +264,8 @@ int main() {
 
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
+    programState->camera.MovementSpeed = CAMERA_SPEED;
+    glfwSwapInterval(programState->vsync ? 1 : 0);
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -206,67 +286,65 @@ int main() {
     // build and compile shaders
     // -------------------------
     Shader ourShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
+    Shader instancedShader("resources/shaders/model_lighting_instanced.vs", "resources/shaders/model_lighting.fs");
+    // per-object uniform, resolved once instead of on every draw
+    UniformHandle<glm::mat4> modelUniform = ourShader.getUniform<glm::mat4>("model");
+    // geometry pass of the deferred path, same vertex shaders
+    Shader gbufferShader("resources/shaders/model_lighting.vs", "resources/shaders/gbuffer.fs");
+    Shader gbufferInstancedShader("resources/shaders/model_lighting_instanced.vs", "resources/shaders/gbuffer.fs");
+    UniformHandle<glm::mat4> gbufferModelUniform = gbufferShader.getUniform<glm::mat4>("model");
+    // the diner's textures are packed into texture arrays, so it gets variants of both that sample those
+    Shader dinerShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs", nullptr, "TEXTURE_ARRAYS");
+    UniformHandle<glm::mat4> dinerModelUniform = dinerShader.getUniform<glm::mat4>("model");
+    Shader gbufferDinerShader("resources/shaders/model_lighting.vs", "resources/shaders/gbuffer.fs", nullptr, "TEXTURE_ARRAYS");
+    UniformHandle<glm::mat4> gbufferDinerModelUniform = gbufferDinerShader.getUniform<glm::mat4>("model");
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
     Shader planeShader("resources/shaders/planeShader.vs", "resources/shaders/planeShader.fs");
     Shader blendingShader("resources/shaders/blending.vs", "resources/shaders/blending.fs");
+    Shader grassShader("resources/shaders/blending_instanced.vs", "resources/shaders/blending.fs");
     Shader parallaxShader("resources/shaders/parallax_mapping.vs", "resources/shaders/parallax_mapping.fs");
+    Shader coneStepShader("resources/shaders/parallax_mapping.vs", "resources/shaders/parallax_mapping.fs", nullptr, "CONE_STEP_MAPPING");
     Shader normalShader("resources/shaders/normal_mapping.vs", "resources/shaders/normal_mapping.fs");
 
     // load models
     // -----------
-    Model garage("resources/objects/garage/garage.obj");
-    garage.SetShaderTextureNamePrefix("material.");
-
-    Model diner("resources/objects/diner/DioramaDiner.obj");
-    diner.SetShaderTextureNamePrefix("material.");
+    // models are imported on loader threads and uploaded by ModelCache::Update in the render loop, drawing
+    // nothing until they are ready; the remaining textures are decoded on all cores in TextureCache::EndBatch below
+    double loadStart = glfwGetTime();
+    TextureCache::BeginBatch();
 
-    Model pony("resources/objects/pony_car/Pony_cartoon.obj");
-    pony.SetShaderTextureNamePrefix("material.");
+    // every instance of the same .obj shares one import, one set of buffers and one set of textures
+    ModelInstance garage(ModelCache::AcquireAsync("resources/objects/garage/garage.obj"));
 
-    Model dodge("resources/objects/dodge/dodge.obj");
-    dodge.SetShaderTextureNamePrefix("material.");
+    ModelInstance diner(ModelCache::AcquireAsync("resources/objects/diner/DioramaDiner.obj"));
+    diner.PackTextureArrays();
 
-    Model lamp("resources/objects/street_lamp/street_lamp_02.obj");
-    lamp.SetShaderTextureNamePrefix("material.");
+    ModelInstance pony(ModelCache::AcquireAsync("resources/objects/pony_car/Pony_cartoon.obj"));
 
-    Model crashed("resources/objects/crashed_car/car03.obj");
-    crashed.SetShaderTextureNamePrefix("material.");
+    ModelInstance dodge(ModelCache::AcquireAsync("resources/objects/dodge/dodge.obj"));
 
-    Model road("resources/objects/road/road.obj");
-    road.SetShaderTextureNamePrefix("material.");
+    ModelInstance lamp(ModelCache::AcquireAsync("resources/objects/street_lamp/street_lamp_02.obj"));
 
-    Model road1("resources/objects/road/road.obj");
-    road1.SetShaderTextureNamePrefix("material.");
+    ModelInstance crashed(ModelCache::AcquireAsync("resources/objects/crashed_car/car03.obj"));
 
-    Model road2("resources/objects/road1/road.obj");
-    road2.SetShaderTextureNamePrefix("material.");
+    ModelInstance road(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
 
-    Model road3("resources/objects/road1/road.obj");
-    road3.SetShaderTextureNamePrefix("material.");
+    ModelInstance road1(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
+    ModelInstance road2(ModelCache::AcquireAsync("resources/objects/road1/road.obj"));
 
-    Model road4("resources/objects/road1/road.obj");
-    road4.SetShaderTextureNamePrefix("material.");
+    ModelInstance road3(ModelCache::AcquireAsync("resources/objects/road1/road.obj"));
+    ModelInstance road4(ModelCache::AcquireAsync("resources/objects/road1/road.obj"));
+    ModelInstance road5(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
+    ModelInstance road6(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
+    ModelInstance road7(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
+    ModelInstance road8(ModelCache::AcquireAsync("resources/objects/road/road.obj"));
 
-    Model road5("resources/objects/road/road.obj");
-    road5.SetShaderTextureNamePrefix("material.");
+    ModelInstance road9(ModelCache::AcquireAsync("resources/objects/road2/road.obj"));
 
-    Model road6("resources/objects/road/road.obj");
-    road6.SetShaderTextureNamePrefix("material.");
+    ModelInstance road_without_side(ModelCache::AcquireAsync("resources/objects/road1/road.obj"));
+    ModelInstance road1_without_side(ModelCache::AcquireAsync("resources/objects/road1/road.obj"));
 
-    Model road7("resources/objects/road/road.obj");
-    road7.SetShaderTextureNamePrefix("material.");
-
-    Model road8("resources/objects/road/road.obj");
-    road8.SetShaderTextureNamePrefix("material.");
-
-    Model road9("resources/objects/road2/road.obj");
-    road9.SetShaderTextureNamePrefix("material.");
-
-    Model road_without_side("resources/objects/road1/road.obj");
-    road_without_side.SetShaderTextureNamePrefix("material.");
-
-    Model road1_without_side("resources/objects/road1/road.obj");
-    road1_without_side.SetShaderTextureNamePrefix("material.");
+    double modelsLoaded = glfwGetTime();
 
     PointLight& pointLight1 = programState->pointLight;
     pointLight1.position = glm::vec3(-10, 445, 50);
@@ -346,44 +424,21 @@ int main() {
 
     unsigned int cardboardTexture = loadTexture(FileSystem::getPath("resources/textures/cardboard.jpg").c_str(), true);
 
-    // Grass vertices
-    float transparentVertices[] = {
-            // positions         // texture Coords
-            0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
-            0.0f, -0.5f,  0.0f,  0.0f,  1.0f,
-            1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
-
-            0.0f,  0.5f,  0.0f,  0.0f,  0.0f,
-            1.0f, -0.5f,  0.0f,  1.0f,  1.0f,
-            1.0f,  0.5f,  0.0f,  1.0f,  0.0f
-    };
-
-    // transparent vegetation location
-    vector<glm::vec3> pozicija_trave;
-    vector<float> rotacija_trave;
+    // transparent vegetation, all blades live in one instance buffer
+    Vegetation trava(100.0f);
 
     //Grass positions
     for(float i = 0; i < 28 ; i++){
-        pozicija_trave.push_back(glm::vec3(90.0f, 40.0f, -500.0f-25.0f*i));
-        rotacija_trave.push_back(rand()%90);
+        trava.Add(glm::vec3(90.0f, 40.0f, -500.0f-25.0f*i), rand()%90);
     }
-
-    // transparent VAO
-    unsigned int transparentVAO, transparentVBO;
-    glGenVertexArrays(1, &transparentVAO);
-    glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
+    // roadside verge behind the street lamps
+    trava.Scatter(glm::vec3(620.0f, 40.0f, -4700.0f), glm::vec3(900.0f, 40.0f, 3600.0f), ROADSIDE_GRASS_BLADES);
 
     unsigned int grassTexture = loadTexture(FileSystem::getPath("resources/textures/trava.png").c_str(), true);
     blendingShader.use();
     blendingShader.setInt("texture1", 0);
+    grassShader.use();
+    grassShader.setInt("texture1", 0);
 
     //plane
     float planeVertices[] = {
@@ -425,7 +480,7 @@ int main() {
 
     //sahta
     unsigned int diffuseMap = loadTexture(FileSystem::getPath("resources/textures/metal.jpg").c_str(), true);
-    unsigned int normalMap  = loadTexture(FileSystem::getPath("resources/textures/metal_normal_map.png").c_str(), true);
+    unsigned int normalMap  = loadNormalMap(FileSystem::getPath("resources/textures/metal_normal_map.png").c_str());
     unsigned int heightMap  = loadTexture(FileSystem::getPath("resources/textures/metal_height_map.png").c_str(), true);
 
     parallaxShader.use();
@@ -433,9 +488,16 @@ int main() {
     parallaxShader.setInt("normalMap", 1);
     parallaxShader.setInt("depthMap", 2);
 
+    // relaxed cone stepping instead of the linear search, built from the same height map; C switches
+    unsigned int coneMap = ConeStepMap::Load(FileSystem::getPath("resources/textures/metal_height_map.png"));
+    coneStepShader.use();
+    coneStepShader.setInt("diffuseMap", 0);
+    coneStepShader.setInt("normalMap", 1);
+    coneStepShader.setInt("coneMap", 2);
+
     //paper
     unsigned int diffuseMapPaper = loadTexture(FileSystem::getPath("resources/textures/paper.jpg").c_str(), true);
-    unsigned int normalMapPaper  = loadTexture(FileSystem::getPath("resources/textures/paper_normal_map.png").c_str(), true);
+    unsigned int normalMapPaper  = loadNormalMap(FileSystem::getPath("resources/textures/paper_normal_map.png").c_str());
 
     normalShader.use();
     normalShader.setInt("diffuseMap", 0);
@@ -519,16 +581,21 @@ int main() {
     unsigned int cubemapTextureDay = loadCubemap(facesDay);
     unsigned int cubemapTextureNight = loadCubemap(facesNight);
 
+    double texturesQueued = glfwGetTime();
+    TextureCache::EndBatch();
+    std::cout << "STARTUP:: model requests " << (modelsLoaded - loadStart) * 1000.0 << " ms, scene setup "
+              << (texturesQueued - modelsLoaded) * 1000.0 << " ms, texture decode+upload "
+              << (glfwGetTime() - texturesQueued) * 1000.0 << " ms, total " << (glfwGetTime() - loadStart) * 1000.0
+              << " ms, " << ModelCache::Loading() << " models still streaming" << std::endl;
+
     skyboxShader.use();
     skyboxShader.setInt("skybox",0);
     glm::vec3 pozicija_dodga = glm::vec3(450, 0, 3685);
 
-    //brojaci za kretanje auta i svetla
-    int brojac = 3685;
-    float desni_far = 3608.47;
-    float levi_far = 3607.11;
-    float desni_far_2 = 3592.42;
-    float levi_far_2 = 3591.98;
+    // the dodge and the camera, advanced by fixed steps in the render loop
+    FixedTimestep simulation(SIMULATION_RATE);
+    SimulationState current = {programState->camera.Position, DODGE_START_Z};
+    SimulationState previous = current;
 
     // lamp positions
     vector<glm::vec3> pozicija_lampe;
@@ -544,97 +611,280 @@ int main() {
         pozicija_svetla.push_back(glm::vec3(556, 153, 3570 - 900*i));
     }
 
-    vector<string> pointlightsPos({
-        "pointLight1.position",
-        "pointLight2.position",
-        "pointLight3.position",
-        "pointLight4.position",
-        "pointLight5.position",
-        "pointLight6.position",
-        "pointLight7.position",
-        "pointLight8.position",
-        "pointLight9.position",
-        "pointLight10.position",
-
-    });
-    vector<string> pointlightsAmb({
-        "pointLight1.ambient",
-        "pointLight2.ambient",
-        "pointLight3.ambient",
-        "pointLight4.ambient",
-        "pointLight5.ambient",
-        "pointLight6.ambient",
-        "pointLight7.ambient",
-        "pointLight8.ambient",
-        "pointLight9.ambient",
-        "pointLight10.ambient",
-
-        });
-    vector<string> pointlightsDiff({
-        "pointLight1.diffuse",
-        "pointLight2.diffuse",
-        "pointLight3.diffuse",
-        "pointLight4.diffuse",
-        "pointLight5.diffuse",
-        "pointLight6.diffuse",
-        "pointLight7.diffuse",
-        "pointLight8.diffuse",
-        "pointLight9.diffuse",
-        "pointLight10.diffuse",
-
-        });
-    vector<string> pointlightsSpec({
-        "pointLight1.specular",
-        "pointLight2.specular",
-        "pointLight3.specular",
-        "pointLight4.specular",
-        "pointLight5.specular",
-        "pointLight6.specular",
-        "pointLight7.specular",
-        "pointLight8.specular",
-        "pointLight9.specular",
-        "pointLight10.specular",
-
-        });
-    vector<string> pointlightsConst({
-        "pointLight1.constant",
-        "pointLight2.constant",
-        "pointLight3.constant",
-        "pointLight4.constant",
-        "pointLight5.constant",
-        "pointLight6.constant",
-        "pointLight7.constant",
-        "pointLight8.constant",
-        "pointLight9.constant",
-        "pointLight10.constant",
-
-        });
-    vector<string> pointlightsLin({
-        "pointLight1.linear",
-        "pointLight2.linear",
-        "pointLight3.linear",
-        "pointLight4.linear",
-        "pointLight5.linear",
-        "pointLight6.linear",
-        "pointLight7.linear",
-        "pointLight8.linear",
-        "pointLight9.linear",
-        "pointLight10.linear",
-
-        });
-    vector<string> pointlightsQuad({
-        "pointLight1.quadratic",
-        "pointLight2.quadratic",
-        "pointLight3.quadratic",
-        "pointLight4.quadratic",
-        "pointLight5.quadratic",
-        "pointLight6.quadratic",
-        "pointLight7.quadratic",
-        "pointLight8.quadratic",
-        "pointLight9.quadratic",
-        "pointLight10.quadratic",
-
-        });
+    // spot and point lights are binned into view space clusters every frame, so a fragment only
+    // evaluates the lights that reach it; the render loop just moves the dodge headlights
+    ClusteredLights clusteredLights;
+    auto spotlight = [](glm::vec3 position, glm::vec3 direction, float quadratic) {
+        return ClusterLight::Spot(position, direction, glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(17.5f)),
+                                  glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1, 0.8, 0.1), glm::vec3(0.5f, 0.5f, 0.5f),
+                                  1.0f, 0.0f, quadratic);
+    };
+    auto pointLight = [&](glm::vec3 position, float quadratic) {
+        return ClusterLight::Point(position, pointLight1.ambient, pointLight1.diffuse, pointLight1.specular,
+                                   pointLight1.constant, pointLight1.linear, quadratic);
+    };
+    vector<ClusterLight> &sceneLights = clusteredLights.lights;
+
+    //spotlight2, desni far, pony
+    sceneLights.push_back(spotlight(glm::vec3(34.29f, 36.21f, -53.63f), glm::vec3(0.985f, -0.158f, -0.058f), 0.00001f));
+    //spotlight3, desni far, svetlo ka faru, pony
+    sceneLights.push_back(spotlight(glm::vec3(64.38f, 33.26f, -54.59f), glm::vec3(-0.999f, 0.027f, 0.032f), 0.004f));
+    //spotlight4, levi far, pony
+    sceneLights.push_back(spotlight(glm::vec3(43.17f, 34.06f, -112.10f), glm::vec3(0.989f, -0.142f, 0.048f), 0.00001f));
+    //spotlight5, levi far, svetlo ka faru, pony
+    sceneLights.push_back(spotlight(glm::vec3(66.82f, 37.20f, -113.89f), glm::vec3(-0.964f, -0.224f, 0.135f), 0.004f));
+    //spotlight6-9, farovi dodge-a, z follows the car every frame
+    const size_t dodgeHeadlights = sceneLights.size();
+    // desni far, desni far 2, levi far, levi far 2 relative to the car
+    const float dodgeHeadlightZ[4] = {3608.47f - DODGE_START_Z, 3592.42f - DODGE_START_Z,
+                                      3607.11f - DODGE_START_Z, 3591.98f - DODGE_START_Z};
+    sceneLights.push_back(spotlight(glm::vec3(474.04f, 23.76f, 0.0f), glm::vec3(-0.0001f, -0.103f, -0.995f), 0.00001f));
+    sceneLights.push_back(spotlight(glm::vec3(475.07f, 24.54f, 0.0f), glm::vec3(-0.009f, -0.052f, 0.999f), 0.004f));
+    sceneLights.push_back(spotlight(glm::vec3(425.63f, 23.41f, 0.0f), glm::vec3(-0.012f, -0.104f, -0.995f), 0.00001f));
+    sceneLights.push_back(spotlight(glm::vec3(425.07f, 24.54f, 0.0f), glm::vec3(-0.009f, -0.052f, 0.999f), 0.004f));
+
+    // pointlights, ulicna rasveta
+    for(unsigned int i = 0; i < pozicija_svetla.size(); i++){
+        sceneLights.push_back(pointLight(pozicija_svetla[i], pointLight1.quadratic));
+    }
+    // diner sign light1, light2 and the one kod ulaza
+    sceneLights.push_back(pointLight(glm::vec3(-290, 223, -680), 0.007f));
+    sceneLights.push_back(pointLight(glm::vec3(-290, 223, -770), 0.007f));
+    sceneLights.push_back(pointLight(glm::vec3(60, 100, -1193), 0.001f));
+    // svetlo iznutra1, iznutra2
+    sceneLights.push_back(pointLight(glm::vec3(-347, 124, -702), 0.01f));
+    sceneLights.push_back(pointLight(glm::vec3(-350, 113, -921), 0.01f));
+
+    ClusteredLights::BindSamplers(ourShader);
+    ClusteredLights::BindSamplers(instancedShader);
+    ClusteredLights::BindSamplers(dinerShader);
+    // shadows of the directional light, the static casters cached between frames; H toggles them
+    CascadedShadowMaps shadowMaps;
+    for (Shader *shader : {&ourShader, &instancedShader, &dinerShader, &planeShader})
+        CascadedShadowMaps::BindSamplers(*shader);
+    // the model shaders keep their samplers in a Material struct, every texture type on fixed units
+    for (Shader *shader : {&ourShader, &instancedShader, &dinerShader, &gbufferShader, &gbufferInstancedShader, &gbufferDinerShader})
+        Material::BindSamplers(*shader, "material.");
+
+    // the directional light and the rest of the per-frame light state live in one uniform block
+    LightsBlock lights = {};
+
+    // directional light
+    lights.dirLight.direction = dirLight.direction;
+    lights.dirLight.ambient = dirLight.ambient;
+    lights.dirLight.diffuse = dirLight.diffuse;
+    lights.dirLight.specular = dirLight.specular;
+
+    lights.lightPos = glm::vec3(3.0f, 450.0f, 40.0f);
+
+    UniformBuffer<LightsBlock> lightsBuffer(LIGHTS_BLOCK_BINDING);
+    UniformBuffer<CameraBlock> cameraBuffer(CAMERA_BLOCK_BINDING);
+    CameraBlock camera = {};
+
+    // model transforms, everything except the dodge stays in place
+    // ---------------------------------------------------------------
+    garage.transform = glm::translate(glm::mat4(1.0f), programState->garagePosition);
+    garage.transform = glm::scale(garage.transform, glm::vec3(programState->garageScale));
+    garage.transform = glm::rotate(garage.transform, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+
+    diner.transform = glm::translate(glm::mat4(1.0f), programState->dinerPosition);
+    diner.transform = glm::scale(diner.transform, glm::vec3(programState->dinerScale));
+    diner.transform = glm::rotate(diner.transform, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+
+    pony.transform = glm::translate(glm::mat4(1.0f), programState->ponyPosition);
+    pony.transform = glm::scale(pony.transform, glm::vec3(programState->ponyScale));
+    pony.transform = glm::rotate(pony.transform, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+
+    crashed.transform = glm::translate(glm::mat4(1.0f), programState->crashedPosition);
+    crashed.transform = glm::scale(crashed.transform, glm::vec3(programState->crashedScale));
+    crashed.transform = glm::rotate(crashed.transform, glm::radians(180.0f), glm::vec3 (0.0, 1.0f, 1.0f));
+    crashed.transform = glm::rotate(crashed.transform, glm::radians(20.0f), glm::vec3 (0.0f, 0.0f, 1.0f));
+    crashed.transform = glm::rotate(crashed.transform, glm::radians(5.0f), glm::vec3 (0.0f, 1.0f, 0.0f));
+
+    // street lamps, all drawn together from one instance buffer
+    ModelInstanceBatch lampBatch(lamp.model);
+    for(unsigned int i = 0; i < pozicija_lampe.size(); i++) {
+        glm::mat4 lampTransform = glm::translate(glm::mat4(1.0f), pozicija_lampe[i]);
+        lampTransform = glm::scale(lampTransform, glm::vec3(programState->lampScale));
+        lampBatch.transforms.push_back(lampTransform);
+    }
+
+    road.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition);
+    road.transform = glm::scale(road.transform, glm::vec3(programState->roadScale));
+
+    road1.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition1);
+    road1.transform = glm::scale(road1.transform, glm::vec3(programState->roadScale));
+
+    road2.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition2);
+    road2.transform = glm::scale(road2.transform, glm::vec3(programState->roadScale));
+
+    road3.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition3);
+    road3.transform = glm::scale(road3.transform, glm::vec3(programState->roadScale));
+
+    road4.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition4);
+    road4.transform = glm::scale(road4.transform, glm::vec3(programState->roadScale));
+
+    road5.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition5);
+    road5.transform = glm::scale(road5.transform, glm::vec3(programState->roadScale));
+
+    road6.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition6);
+    road6.transform = glm::scale(road6.transform, glm::vec3(programState->roadScale));
+
+    road7.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition7);
+    road7.transform = glm::scale(road7.transform, glm::vec3(40.0f, 40.0f, 150.0f));
+
+    road8.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition8);
+    road8.transform = glm::scale(road8.transform, glm::vec3(40.0f, 40.0f, 130.0f));
+
+    road9.transform = glm::translate(glm::mat4(1.0f), programState->roadPosition9);
+    road9.transform = glm::scale(road9.transform, glm::vec3(40.0f, 40.0f, 28.0f));
+
+    //bez bankine prvi
+    road_without_side.transform = glm::translate(glm::mat4(1.0f), programState->road_without_side_Position);
+    road_without_side.transform = glm::scale(road_without_side.transform, glm::vec3(programState->road_without_side));
+    road_without_side.transform = glm::rotate(road_without_side.transform, glm::radians(225.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+
+    //bez bankine drugi
+    road1_without_side.transform = glm::translate(glm::mat4(1.0f), programState->road1_without_side_Position);
+    road1_without_side.transform = glm::rotate(road1_without_side.transform, glm::radians(150.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+    road1_without_side.transform = glm::scale(road1_without_side.transform, glm::vec3(45.0f, 60.0f, 70.0f));
+
+    // the dodge drives along z, the simulation steps move it
+    auto dodgeTransform = [&](float z) {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(450, 0, z));
+        transform = glm::scale(transform, glm::vec3(programState->dodgeScale));
+        return glm::rotate(transform, glm::radians(180.0f), glm::vec3 (0.0, 1.0f, 0.0f));
+    };
+
+    // road segments grouped by the .obj they share, each group is drawn instanced
+    ModelInstanceBatch roadBatch(road.model);
+    for (ModelInstance *segment : {&road, &road1, &road5, &road6, &road7, &road8})
+        roadBatch.transforms.push_back(segment->transform);
+    ModelInstanceBatch road1Batch(road2.model);
+    for (ModelInstance *segment : {&road2, &road3, &road4, &road_without_side, &road1_without_side})
+        road1Batch.transforms.push_back(segment->transform);
+    ModelInstanceBatch road2Batch(road9.model);
+    road2Batch.transforms.push_back(road9.transform);
+
+    // per-program constants, lights and camera come from the uniform buffers
+    for (Shader *shader : {&ourShader, &instancedShader, &dinerShader}) {
+        shader->use();
+        shader->setFloat("material.shininess", 32.0f);
+    }
+    planeShader.use();
+    planeShader.setFloat("shininess", 32.0f);
+
+    // the lit models go through one of two paths, G toggles between them: forward shading with the
+    // clustered light lists, or deferred shading through a G-buffer; their GPU times are reported side by side
+    auto submitModels = [&](RenderQueue &queue, Shader &shader, const UniformHandle<glm::mat4> &modelMatrix, Shader &instanced,
+                            Shader &textureArrays, const UniformHandle<glm::mat4> &textureArraysModelMatrix) {
+        for (ModelInstance *instance : {&garage, &pony, &dodge, &crashed})
+            instance->Submit(queue, shader, modelMatrix);
+        diner.Submit(queue, textureArrays, textureArraysModelMatrix);
+
+        // street lamps and road, one instanced draw per mesh of each model
+        for (ModelInstanceBatch *batch : {&lampBatch, &roadBatch, &road1Batch, &road2Batch})
+            batch->Submit(queue, instanced);
+    };
+
+    // shadow casters: everything but the dodge stands still and goes into the cached cascades, the
+    // dodge is drawn over them every frame
+    auto drawStaticCasters = [&](ShadowPass &pass) {
+        for (ModelInstance *instance : {&garage, &diner, &pony, &crashed})
+            pass.Draw(*instance);
+        for (ModelInstanceBatch *batch : {&lampBatch, &roadBatch, &road1Batch, &road2Batch})
+            pass.Draw(*batch);
+    };
+    auto drawDynamicCasters = [&](ShadowPass &pass) {
+        pass.Draw(dodge);
+    };
+
+    // everything that isn't a model stays where it is
+    glm::mat4 planeModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -6.0f, 0.0f)), glm::vec3(100));
+    glm::mat4 cardboardModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-280.0f, 35.5f, -550.0f)), glm::vec3(25.0f));
+    glm::mat4 manholeModel = glm::translate(glm::mat4(1.0f), glm::vec3(-395.0f, 20.0f, -1196.0f));
+    manholeModel = glm::rotate(manholeModel, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    manholeModel = glm::scale(manholeModel, glm::vec3(40.0f, 40.0f, 40.0f));
+    glm::mat4 paperModel = glm::translate(glm::mat4(1.0f), glm::vec3(-315.0f, 66.5f, -656.0f));
+    paperModel = glm::rotate(paperModel, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    paperModel = glm::scale(paperModel, glm::vec3(5.0f, 5.0f, 5.0f));
+
+    // every draw of a frame goes through a render queue, sorted by program, textures and VAO to skip
+    // redundant binds and front to back within those; the G-buffer pass has a queue of its own
+    RenderQueue renderQueue, gbufferQueue;
+
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    DeferredRenderer deferredRenderer(framebufferWidth, framebufferHeight);
+
+    // every placed object goes into one BVH, which answers the frustum, light and picking queries of
+    // the render loop; sceneItems maps its item numbers back to the instance or the batched copy
+    struct SceneItem {
+        const char *name;
+        ModelInstance *instance;
+        ModelInstanceBatch *batch;
+        unsigned int copy;
+    };
+    std::vector<SceneItem> sceneItems;
+    std::vector<std::pair<const char *, ModelInstance *>> placedInstances = {
+            {"garage", &garage}, {"diner", &diner}, {"pony", &pony}, {"dodge", &dodge}, {"crashed car", &crashed}};
+    for (auto &placed : placedInstances)
+        sceneItems.push_back({placed.first, placed.second, nullptr, 0});
+    std::vector<std::pair<const char *, ModelInstanceBatch *>> placedBatches = {
+            {"street lamp", &lampBatch}, {"road", &roadBatch}, {"road", &road1Batch}, {"road", &road2Batch}};
+    for (auto &placed : placedBatches) {
+        for (unsigned int copy = 0; copy < placed.second->transforms.size(); copy++)
+            sceneItems.push_back({placed.first, nullptr, placed.second, copy});
+    }
+    const unsigned int dodgeItem = 3; // its place in placedInstances
+
+    // world box of an item, empty while its model is still streaming
+    auto sceneItemBounds = [](const SceneItem &item) {
+        const shared_ptr<Model> &model = item.instance ? item.instance->model : item.batch->model;
+        if (!model->IsReady())
+            return BoundingBox();
+        return model->bounds.Transformed(item.instance ? item.instance->transform : item.batch->transforms[item.copy]);
+    };
+
+    // the models stream in, so the items join the tree as they become ready, and the box around the
+    // shadow casters grows with them
+    SceneBvh sceneBvh;
+    BoundingBox shadowCasters;
+    std::vector<unsigned int> pendingItems;
+    for (const SceneItem &item : sceneItems)
+        pendingItems.push_back(sceneBvh.Insert(sceneItemBounds(item)));
+
+    // lights whose sphere touches no object are left out of the clusters and the light volumes
+    std::vector<unsigned int> litItems;
+    clusteredLights.reachesGeometry = [&](const glm::vec3 &center, float radius) {
+        litItems.clear();
+        sceneBvh.QuerySphere(center, radius, litItems);
+        return !litItems.empty();
+    };
+
+    // the objects the BVH finds in view then have their meshes (or batched copies) tested one by one
+    FrustumCuller culler;
+    std::vector<unsigned int> visibleItems;
+    unsigned long culledTotal = 0, testedTotal = 0, visibleItemTotal = 0;
+
+    // objects in view but hidden behind others (mostly by the diner and the garage) are skipped
+    // based on the occlusion queries of earlier frames; O toggles it
+    OcclusionCuller occlusion((unsigned int)sceneItems.size());
+    std::vector<BoundingBox> occlusionBoxes;
+    unsigned long occludedTotal = 0;
+
+    // what passed picks its level of detail from its size on screen; L toggles it
+    LodSelector lodSelector;
+    unsigned long triangleTotal = 0, vertexArrayBindTotal = 0, shadowTriangleTotal = 0;
+
+    // section 0 forward, 1 deferred
+    GpuTimer frameTimer(2);
+    // the manhole alone, section 0 linear search, 1 cone stepping
+    GpuTimer parallaxTimer(2);
+    bool reportedDeferred = programState->deferredShading;
+    double reportStart = glfwGetTime();
+    double frameTimeTotal = 0.0;
+    unsigned int reportFrames = 0;
 
     // render loop
     // -----------
@@ -650,480 +900,289 @@ int main() {
         processInput(window);
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+        // simulation
+        // ----------
+        // as many fixed steps as fit in the time since the last frame, then the frame draws the camera
+        // and the dodge where they were that far into the last step
+        programState->camera.Position = current.cameraPosition;
+        for (unsigned int steps = simulation.Advance(deltaTime); steps > 0; steps--) {
+            previous = current;
+            processMovement(window, simulation.Step());
+            current.cameraPosition = programState->camera.Position;
+            current.dodgeZ -= DODGE_SPEED * simulation.Step();
+            if (current.dodgeZ <= DODGE_END_Z) {
+                // back to the start, not sweeping back along the road
+                current.dodgeZ = DODGE_START_Z;
+                previous.dodgeZ = current.dodgeZ;
+            }
+        }
+        programState->camera.Position = glm::mix(previous.cameraPosition, current.cameraPosition, simulation.Alpha());
+        float dodgeZ = glm::mix(previous.dodgeZ, current.dodgeZ, simulation.Alpha());
+
+        // streaming
+        // ---------
+        ModelCache::Update(STREAMING_BUDGET_MS);
+
 
         // render
         // ------
+        frameTimer.Begin(programState->deferredShading ? 1 : 0);
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        //plane shader
-        planeShader.use();
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
-        planeShader.setMat4("view", view);
-        planeShader.setMat4("projection", projection);
-
-        glBindVertexArray(planeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, groundTexture);
-        model = glm::translate(model, glm::vec3(0.0f, -6.0f, 0.0f));
-        model = glm::scale(model, glm::vec3 (100));
-        planeShader.setMat4("model", model);
-
-        planeShader.setBool("noc", noc);
-        planeShader.setVec3("dirLight.direction", dirLight.direction);
-        planeShader.setVec3("dirLight.ambientDay", dirLight.ambient);
-        planeShader.setVec3("dirLight.diffuseDay", 0.1f, 0.1f,0.1f);
-        planeShader.setVec3("dirLight.specularDay", dirLight.specular);
-        planeShader.setVec3("dirLight.ambientNight", 0.0f, 0.0f,0.0f);
-        planeShader.setVec3("dirLight.diffuseNight", 0.1f, 0.1f, 0.1f);
-        planeShader.setVec3("dirLight.specularNight", 0.0f, 0.0f,0.0f);
-        planeShader.setFloat("shininess", 32.0f);
-
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-
-        // blending shader
-        // trava
-        blendingShader.use();
-        glm::mat4 trava_model = glm::mat4(1.0f);
-        blendingShader.setMat4("projection", projection);
-        blendingShader.setMat4("view", view);
-        glBindVertexArray(transparentVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, grassTexture);
-        for (unsigned int i = 0; i < 28; i++)
-        {
-            trava_model = glm::mat4(1.0f);
-            trava_model = glm::translate(trava_model, pozicija_trave[i]);
-            trava_model = glm::scale(trava_model, glm::vec3(100.0f));
-            trava_model = glm::rotate(trava_model ,glm::radians(rotacija_trave[i]), glm::vec3(0.0f ,1.0f, 0.0f));
-            blendingShader.setMat4("model", trava_model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+        // view/projection transformations and lights, one upload per block for every shader
+        camera.view = programState->camera.GetViewMatrix();
+        float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        camera.projection = glm::perspective(glm::radians(programState->camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
+        camera.viewPosition = programState->camera.Position;
+        cameraBuffer.Upload(camera);
+
+        lights.noc = noc;
+        lightsBuffer.Upload(lights);
+
+        for (unsigned int i = 0; i < 4; i++)
+            sceneLights[dodgeHeadlights + i].position.z = dodgeZ + dodgeHeadlightZ[i];
+
+        //dodge
+        dodge.transform = dodgeTransform(dodgeZ);
+
+        // scene BVH: streamed models that became ready join it, rebuilt once the last one did, and
+        // the dodge is refit where it drove to
+        if (!pendingItems.empty()) {
+            for (size_t i = 0; i < pendingItems.size(); ) {
+                BoundingBox bounds = sceneItemBounds(sceneItems[pendingItems[i]]);
+                if (bounds.IsEmpty()) {
+                    i++;
+                    continue;
+                }
+                sceneBvh.Refit(pendingItems[i], bounds);
+                shadowCasters.Extend(bounds);
+                if (pendingItems[i] == dodgeItem) {
+                    // it casts wherever it drives
+                    shadowCasters.Extend(dodge.model->bounds.Transformed(dodgeTransform(DODGE_START_Z)));
+                    shadowCasters.Extend(dodge.model->bounds.Transformed(dodgeTransform(DODGE_END_Z)));
+                } else {
+                    shadowMaps.Invalidate();
+                }
+                pendingItems.erase(pendingItems.begin() + i);
+            }
+            if (pendingItems.empty())
+                sceneBvh.Rebuild();
+        }
+        sceneBvh.Refit(dodgeItem, sceneItemBounds(sceneItems[dodgeItem]), DODGE_BVH_MARGIN);
+
+        // shadows of the sun, so only by day
+        if (programState->shadows && !noc) {
+            shadowMaps.Update(camera.view, glm::radians(programState->camera.Zoom), aspect, NEAR_PLANE,
+                              dirLight.direction, shadowCasters);
+            // counted on their own, the model triangles measure what culling and LOD leave of the scene
+            unsigned long drawnTriangles = Mesh::DrawnTriangles();
+            Mesh::DrawnTriangles() = 0;
+            shadowMaps.Render(drawStaticCasters, sceneItemBounds(sceneItems[dodgeItem]), drawDynamicCasters);
+            shadowTriangleTotal += Mesh::DrawnTriangles();
+            Mesh::DrawnTriangles() = drawnTriangles;
+        } else {
+            shadowMaps.Disable();
         }
 
-        // kartonska kutija
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        clusteredLights.Update(camera.view, glm::radians(programState->camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
+
+        // frustum culling, both shading paths draw only what passed
+        culler.Begin(camera.projection * camera.view);
+        for (ModelInstance *instance : {&garage, &diner, &pony, &dodge, &crashed})
+            instance->Hide();
+        for (ModelInstanceBatch *batch : {&lampBatch, &roadBatch, &road1Batch, &road2Batch})
+            batch->Hide();
+        visibleItems.clear();
+        sceneBvh.QueryFrustum(culler.GetFrustum(), visibleItems);
+        occlusion.BeginFrame();
+        lodSelector.enabled = programState->levelsOfDetail;
+        lodSelector.SetCamera(programState->camera.Position, glm::radians(programState->camera.Zoom));
+        for (unsigned int item : visibleItems) {
+            if (programState->occlusionCulling && !occlusion.Visible(item)) {
+                occludedTotal++;
+                continue;
+            }
+            if (sceneItems[item].instance) {
+                sceneItems[item].instance->Cull(culler);
+                sceneItems[item].instance->SelectLods(lodSelector);
+            } else {
+                sceneItems[item].batch->Cull(culler, sceneItems[item].copy);
+                sceneItems[item].batch->SelectLod(lodSelector, sceneItems[item].copy);
+            }
+        }
+        culler.Run();
+        culledTotal += culler.Culled();
+        testedTotal += culler.Visible() + culler.Culled();
+        visibleItemTotal += visibleItems.size();
+
+        if (pickRequested) {
+            unsigned int item;
+            float distance;
+            if (sceneBvh.Raycast(programState->camera.Position, programState->camera.Front, FAR_PLANE, item, distance))
+                std::cout << "PICK:: " << sceneItems[item].name << " at " << distance << " units" << std::endl;
+            else
+                std::cout << "PICK:: nothing in front of the camera" << std::endl;
+            pickRequested = false;
+        }
 
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cardboardTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-280.0f, 35.5f, -550.0f));
-        model = glm::scale(model, glm::vec3(25.0f));
-        blendingShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // deferred: the models first, their depth then lets the forward passes below composite over them
+        renderQueue.Begin(programState->camera.Position, FAR_PLANE);
+        if (programState->deferredShading) {
+            gbufferQueue.Begin(programState->camera.Position, FAR_PLANE);
+            submitModels(gbufferQueue, gbufferShader, gbufferModelUniform, gbufferInstancedShader,
+                         gbufferDinerShader, gbufferDinerModelUniform);
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            deferredRenderer.Resize(framebufferWidth, framebufferHeight);
+            deferredRenderer.BeginGeometryPass();
+            gbufferQueue.Execute();
+            deferredRenderer.LightingPass(clusteredLights, noc);
+        } else {
+            // render the loaded models
+            submitModels(renderQueue, ourShader, modelUniform, instancedShader, dinerShader, dinerModelUniform);
+        }
 
-        glDisable(GL_CULL_FACE);
+        //plane shader
+        RenderCommand &plane = renderQueue.Add();
+        plane.shader = &planeShader;
+        plane.vertexArray = planeVAO;
+        plane.AddTexture(groundTexture);
+        plane.draw = [&]() {
+            planeShader.setMat4("model", planeModel);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        };
+        plane.key = renderQueue.Key(RenderQueue::OPAQUE_PASS, plane, glm::vec3(planeModel[3]));
+
+        // trava, every blade in one instanced draw
+        RenderCommand &grass = renderQueue.Add();
+        grass.shader = &grassShader;
+        grass.AddTexture(grassTexture);
+        grass.draw = [&]() {
+            trava.Draw(grassShader);
+        };
+        grass.key = renderQueue.Key(RenderQueue::OPAQUE_PASS, grass, programState->camera.Position);
+
+        // kartonska kutija
+        RenderCommand &cardboard = renderQueue.Add();
+        cardboard.shader = &blendingShader;
+        cardboard.vertexArray = cubeVAO;
+        cardboard.AddTexture(cardboardTexture);
+        cardboard.draw = [&]() {
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_BACK);
+            blendingShader.setMat4("model", cardboardModel);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glDisable(GL_CULL_FACE);
+        };
+        cardboard.key = renderQueue.Key(RenderQueue::OPAQUE_PASS, cardboard, glm::vec3(cardboardModel[3]));
 
         //sahta
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, normalMap);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, heightMap);
-
-        parallaxShader.use();
-
-        parallaxShader.setMat4("projection", projection);
-        parallaxShader.setMat4("view", view);
-        parallaxShader.setVec3("viewPos", programState->camera.Position);
-        parallaxShader.setVec3("lightPos", glm::vec3(3.0f, 450.0f, 40.0f));
-        parallaxShader.setFloat("heightScale", heightScale);
-
-        glm::mat4 quad = glm::mat4(1.0f);
-        quad = glm::translate(quad, glm::vec3(-395.0f, 20.0f, -1196.0f));
-        quad = glm::rotate(quad, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        quad = glm::scale(quad, glm::vec3(40.0f, 40.0f, 40.0f));
-        parallaxShader.setMat4("model", quad);
-        renderQuad();
+        bool coneStepping = programState->coneStepParallax && coneMap != 0;
+        Shader &manholeShader = coneStepping ? coneStepShader : parallaxShader;
+        RenderCommand &manhole = renderQueue.Add();
+        manhole.shader = &manholeShader;
+        manhole.AddTexture(diffuseMap);
+        manhole.AddTexture(normalMap);
+        manhole.AddTexture(coneStepping ? coneMap : heightMap);
+        manhole.draw = [&]() {
+            parallaxTimer.Begin(coneStepping ? 1 : 0);
+            manholeShader.setFloat("heightScale", heightScale);
+            manholeShader.setMat4("model", manholeModel);
+            renderQuad();
+            parallaxTimer.End();
+        };
+        manhole.key = renderQueue.Key(RenderQueue::OPAQUE_PASS, manhole, glm::vec3(manholeModel[3]));
 
         //paper
-        normalShader.use();
-        normalShader.setMat4("projection", projection);
-        normalShader.setMat4("view", view);
-        normalShader.setVec3("viewPos", programState->camera.Position);
-        normalShader.setVec3("lightPos", glm::vec3(3.0f, 450.0f, 40.0f));
-        quad = glm::mat4(1.0f);
-        quad = glm::translate(quad, glm::vec3(-315.0f, 66.5f, -656.0f));
-        quad = glm::rotate(quad, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        quad = glm::scale(quad, glm::vec3(5.0f, 5.0f, 5.0f));
-        normalShader.setMat4("model", quad);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapPaper);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, normalMapPaper);
-        renderQuad();
-
-        //ourShader
-        ourShader.use();
-        ourShader.setBool("noc", noc);
-
-        //spotlight1, svetlo kamere
-        ourShader.setVec3("spotlight1.position", programState->camera.Position);
-        ourShader.setVec3("spotlight1.direction", programState->camera.Front);
-        ourShader.setFloat("spotlight1.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight1.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight1.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight1.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight1.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight1.constant", 1.0f);
-        ourShader.setFloat("spotlight1.linear", 0.0f);
-        ourShader.setFloat("spotlight1.quadratic", 0.00001f);
-
-        //spotlight2, desni far, pony
-        ourShader.setVec3("spotlight2.position", glm::vec3(34.29f, 36.21f, -53.63f));
-        ourShader.setVec3("spotlight2.direction", glm::vec3(0.985f, -0.158f, -0.058f));
-        ourShader.setFloat("spotlight2.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight2.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight2.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight2.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight2.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight2.constant", 1.0f);
-        ourShader.setFloat("spotlight2.linear", 0.0f);
-        ourShader.setFloat("spotlight2.quadratic", 0.00001f);
-
-        //spotlight3, desni far, svetlo ka faru, pony
-        ourShader.setVec3("spotlight3.position", glm::vec3(64.38f, 33.26f, -54.59f));
-        ourShader.setVec3("spotlight3.direction", glm::vec3(-0.999f, 0.027f, 0.032f));
-        ourShader.setFloat("spotlight3.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight3.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight3.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight3.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight3.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight3.constant", 1.0f);
-        ourShader.setFloat("spotlight3.linear", 0.0f);
-        ourShader.setFloat("spotlight3.quadratic", 0.004f);
-
-        //spotlight4, levi far, pony
-        ourShader.setVec3("spotlight4.position", glm::vec3(43.17f, 34.06f, -112.10f));
-        ourShader.setVec3("spotlight4.direction", glm::vec3(0.989f, -0.142f, 0.048f));
-        ourShader.setFloat("spotlight4.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight4.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight4.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight4.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight4.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight4.constant", 1.0f);
-        ourShader.setFloat("spotlight4.linear", 0.0f);
-        ourShader.setFloat("spotlight4.quadratic", 0.00001f);
-
-        //spotlight5, levi far, svetlo ka faru, pony
-        ourShader.setVec3("spotlight5.position", glm::vec3(66.82f, 37.20f, -113.89f));
-        ourShader.setVec3("spotlight5.direction", glm::vec3(-0.964f, -0.224f, 0.135f));
-        ourShader.setFloat("spotlight5.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight5.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight5.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight5.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight5.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight5.constant", 1.0f);
-        ourShader.setFloat("spotlight5.linear", 0.0f);
-        ourShader.setFloat("spotlight5.quadratic", 0.004f);
-
-        //spotlight6, desni far, dodge
-        ourShader.setVec3("spotlight6.position", glm::vec3(474.04f, 23.76f, desni_far));
-        ourShader.setVec3("spotlight6.direction", glm::vec3(-0.0001f, -0.103f, -0.995f));
-        ourShader.setFloat("spotlight6.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight6.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight6.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight6.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight6.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight6.constant", 1.0f);
-        ourShader.setFloat("spotlight6.linear", 0.0f);
-        ourShader.setFloat("spotlight6.quadratic", 0.00001f);
-        desni_far = desni_far - 5;
-
-        //spotlight7, desni far, svetlo ka faru, dodge
-        ourShader.setVec3("spotlight7.position", glm::vec3(475.07f, 24.54f, desni_far_2));
-        ourShader.setVec3("spotlight7.direction", glm::vec3(-0.009f, -0.052f, 0.999f));
-        ourShader.setFloat("spotlight7.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight7.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight7.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight7.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight7.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight7.constant", 1.0f);
-        ourShader.setFloat("spotlight7.linear", 0.0f);
-        ourShader.setFloat("spotlight7.quadratic", 0.004f);
-        desni_far_2 = desni_far_2 - 5;
-
-        //spotlight8, levi far, dodge
-        ourShader.setVec3("spotlight8.position", glm::vec3(425.63f, 23.41f, levi_far));
-        ourShader.setVec3("spotlight8.direction", glm::vec3(-0.012f, -0.104f, -0.995f));
-        ourShader.setFloat("spotlight8.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight8.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight8.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight8.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight8.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight8.constant", 1.0f);
-        ourShader.setFloat("spotlight8.linear", 0.0f);
-        ourShader.setFloat("spotlight8.quadratic", 0.00001f);
-        levi_far = levi_far - 5;
-
-        //spotlight9, levi far, svetlo ka faru, dodge
-        ourShader.setVec3("spotlight9.position", glm::vec3(425.07f, 24.54f, levi_far_2));
-        ourShader.setVec3("spotlight9.direction", glm::vec3(-0.009f, -0.052f, 0.999f));
-        ourShader.setFloat("spotlight9.cutOff", glm::cos(glm::radians(12.5f)));
-        ourShader.setFloat("spotlight9.outerCutOff", glm::cos(glm::radians(17.5f)));
-        ourShader.setVec3("spotlight9.ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-        ourShader.setVec3("spotlight9.diffuse", glm::vec3(1, 0.8, 0.1));
-        ourShader.setVec3("spotlight9.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        ourShader.setFloat("spotlight9.constant", 1.0f);
-        ourShader.setFloat("spotlight9.linear", 0.0f);
-        ourShader.setFloat("spotlight9.quadratic", 0.004f);
-        levi_far_2 = levi_far_2 - 5;
-
-        // pointlights, ulicna rasveta
-        for(unsigned int i = 0; i < 10; i++){
-            ourShader.setVec3(pointlightsPos[i], pozicija_svetla[i]);
-            ourShader.setVec3(pointlightsAmb[i], pointLight1.ambient);
-            ourShader.setVec3(pointlightsDiff[i], pointLight1.diffuse);
-            ourShader.setVec3(pointlightsSpec[i], pointLight1.specular);
-            ourShader.setFloat(pointlightsConst[i], pointLight1.constant);
-            ourShader.setFloat(pointlightsLin[i], pointLight1.linear);
-            ourShader.setFloat(pointlightsQuad[i], pointLight1.quadratic);
-        }
+        RenderCommand &paper = renderQueue.Add();
+        paper.shader = &normalShader;
+        paper.AddTexture(diffuseMapPaper);
+        paper.AddTexture(normalMapPaper);
+        paper.draw = [&]() {
+            normalShader.setMat4("model", paperModel);
+            renderQuad();
+        };
+        paper.key = renderQueue.Key(RenderQueue::OPAQUE_PASS, paper, glm::vec3(paperModel[3]));
+
+        //skybox, behind everything
+        RenderCommand &skybox = renderQueue.Add();
+        skybox.shader = &skyboxShader;
+        skybox.vertexArray = skyboxVAO;
+        skybox.AddTexture(noc ? cubemapTextureNight : cubemapTextureDay, GL_TEXTURE_CUBE_MAP);
+        skybox.draw = []() {
+            glDepthFunc(GL_LEQUAL);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glDepthFunc(GL_LESS);
+        };
+        skybox.key = renderQueue.Key(RenderQueue::SKY_PASS, skybox, programState->camera.Position);
 
-        // diner sign light1
-        ourShader.setVec3("pointLight11.position", glm::vec3(-290, 223, -680));
-        ourShader.setVec3("pointLight11.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight11.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight11.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight11.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight11.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight11.quadratic", 0.007);
-
-        // diner sign light2
-        ourShader.setVec3("pointLight12.position", glm::vec3(-290, 223, -770));
-        ourShader.setVec3("pointLight12.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight12.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight12.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight12.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight12.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight12.quadratic", 0.007);
-
-        // diner sign light kod ulaza
-        ourShader.setVec3("pointLight13.position", glm::vec3(60, 100, -1193));
-        ourShader.setVec3("pointLight13.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight13.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight13.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight13.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight13.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight13.quadratic", 0.001);
-
-        // svetlo iznutra1
-        ourShader.setVec3("pointLight14.position", glm::vec3(-347, 124, -702));
-        ourShader.setVec3("pointLight14.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight14.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight14.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight14.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight14.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight14.quadratic", 0.01);
-
-        // svetlo iznutra2
-        ourShader.setVec3("pointLight15.position", glm::vec3(-350, 113, -921));
-        ourShader.setVec3("pointLight15.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight15.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight15.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight15.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight15.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight15.quadratic", 0.01);
-
-        // directional light
-        ourShader.setVec3("dirLight.direction", dirLight.direction);
-        ourShader.setVec3("dirLight.ambient", dirLight.ambient);
-        ourShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        ourShader.setVec3("dirLight.specular", dirLight.specular);
-
-
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        // view/projection transformations
-        projection = glm::perspective(glm::radians(programState->camera.Zoom),(float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 10000.0f);
-        view = programState->camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // render the loaded model
-
-        //garage
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->garagePosition);
-        model = glm::scale(model, glm::vec3(programState->garageScale));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        garage.Draw(ourShader);
-
-        //diner
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->dinerPosition);
-        model = glm::scale(model, glm::vec3(programState->dinerScale));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        diner.Draw(ourShader);
-
-        //pony
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->ponyPosition);
-        model = glm::scale(model, glm::vec3(programState->ponyScale));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        pony.Draw(ourShader);
-
-        if(brojac == -4730){
-            brojac = 3685;
-            desni_far = 3608.47;
-            levi_far = 3607.11;
-            desni_far_2 = 3592.42;
-            levi_far_2 = 3591.98;
+        renderQueue.Execute(RenderQueue::OPAQUE_PASS);
 
+        // box tests of the objects in view against everything drawn so far, read in a later frame
+        if (programState->occlusionCulling) {
+            occlusionBoxes.clear();
+            for (unsigned int item : visibleItems)
+                occlusionBoxes.push_back(sceneItemBounds(sceneItems[item]));
+            occlusion.Test(visibleItems, occlusionBoxes, programState->camera.Position);
         }
 
-        //dodge
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(450, 0, brojac));
-        model = glm::scale(model, glm::vec3(programState->dodgeScale));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        dodge.Draw(ourShader);
-        brojac = brojac - 5;
-
-        //street lamps
-        for(unsigned int i = 0; i < 10; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pozicija_lampe[i]);
-            model = glm::scale(model, glm::vec3(programState->lampScale));
-            ourShader.setMat4("model", model);
-            lamp.Draw(ourShader);
+        renderQueue.Execute();
+
+        frameTimer.End();
+
+        // average frame times of the path in use, reported periodically and when switching paths
+        frameTimeTotal += deltaTime;
+        triangleTotal += Mesh::DrawnTriangles();
+        Mesh::DrawnTriangles() = 0;
+        vertexArrayBindTotal += GeometryBuffer::VertexArrayBinds();
+        GeometryBuffer::VertexArrayBinds() = 0;
+        reportFrames++;
+        if (programState->deferredShading != reportedDeferred || currentFrame - reportStart >= FRAME_REPORT_INTERVAL) {
+            unsigned int section = reportedDeferred ? 1 : 0;
+            std::cout << "RENDER:: " << (reportedDeferred ? "deferred" : "forward") << " shading: "
+                      << frameTimer.Milliseconds(section) << " ms GPU, " << frameTimeTotal * 1000.0 / reportFrames
+                      << " ms per frame over " << reportFrames << " frames, " << visibleItemTotal / reportFrames
+                      << " of " << sceneItems.size() << " objects in view, " << occludedTotal / reportFrames
+                      << " of them occluded, culled " << culledTotal / reportFrames
+                      << " of " << testedTotal / reportFrames << " of their bounds per frame, "
+                      << triangleTotal / reportFrames << " model triangles and " << vertexArrayBindTotal / reportFrames
+                      << " geometry VAO binds per frame"
+                      << (programState->levelsOfDetail ? "" : " (LOD off)") << std::endl;
+            RenderQueue::Stats queueStats = renderQueue.stats;
+            queueStats.programBinds += gbufferQueue.stats.programBinds;
+            queueStats.programSkips += gbufferQueue.stats.programSkips;
+            queueStats.textureBinds += gbufferQueue.stats.textureBinds;
+            queueStats.textureSkips += gbufferQueue.stats.textureSkips;
+            queueStats.vertexArrayBinds += gbufferQueue.stats.vertexArrayBinds;
+            queueStats.vertexArraySkips += gbufferQueue.stats.vertexArraySkips;
+            std::cout << "RENDER:: render queue: " << queueStats.programBinds / reportFrames << " program binds ("
+                      << queueStats.programSkips / reportFrames << " skipped), " << queueStats.textureBinds / reportFrames
+                      << " texture binds (" << queueStats.textureSkips / reportFrames << " skipped), "
+                      << queueStats.vertexArrayBinds / reportFrames << " VAO binds ("
+                      << queueStats.vertexArraySkips / reportFrames << " skipped) per frame" << std::endl;
+            std::cout << "RENDER:: shadows: " << shadowMaps.stats.staticRenders << " static cascade renders, "
+                      << shadowMaps.stats.dynamicRenders << " dynamic ones and " << shadowMaps.stats.composites
+                      << " cached cascade copies over " << reportFrames << " frames, "
+                      << shadowTriangleTotal / reportFrames << " shadow triangles per frame"
+                      << (programState->shadows ? "" : " (shadows off)") << std::endl;
+            // kept across reports, so both searches can be compared after switching with C
+            std::cout << "RENDER:: manhole parallax: " << parallaxTimer.Milliseconds(0) << " ms GPU linear search ("
+                      << parallaxTimer.Samples(0) << " frames), " << parallaxTimer.Milliseconds(1)
+                      << " ms GPU cone stepping (" << parallaxTimer.Samples(1) << " frames)" << std::endl;
+            std::cout << "RENDER:: simulation: " << simulation.Steps() << " steps of " << simulation.Step() * 1000.0f
+                      << " ms over " << reportFrames << " frames" << (programState->vsync ? "" : " (vsync off)") << std::endl;
+            simulation.Steps() = 0;
+            renderQueue.stats = gbufferQueue.stats = RenderQueue::Stats();
+            shadowMaps.stats = CascadedShadowMaps::Stats();
+            frameTimer.Reset(section);
+            frameTimeTotal = 0.0;
+            culledTotal = testedTotal = visibleItemTotal = occludedTotal = triangleTotal = vertexArrayBindTotal = 0;
+            shadowTriangleTotal = 0;
+            reportFrames = 0;
+            reportStart = currentFrame;
+            reportedDeferred = programState->deferredShading;
         }
 
-        //crashed
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->crashedPosition);
-        model = glm::scale(model, glm::vec3(programState->crashedScale));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3 (0.0, 1.0f, 1.0f));
-        model = glm::rotate(model, glm::radians(20.0f), glm::vec3 (0.0f, 0.0f, 1.0f));
-        model = glm::rotate(model, glm::radians(5.0f), glm::vec3 (0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        crashed.Draw(ourShader);
-
-        //road
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road.Draw(ourShader);
-
-        //road1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition1);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road1.Draw(ourShader);
-
-        //road2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition2);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road2.Draw(ourShader);
-
-        //road3
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition3);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road3.Draw(ourShader);
-
-        //road4
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition4);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road4.Draw(ourShader);
-
-        //road5
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition5);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road5.Draw(ourShader);
-
-        //road6
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition6);
-        model = glm::scale(model, glm::vec3(programState->roadScale));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road6.Draw(ourShader);
-
-        //road7
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition7);
-        model = glm::scale(model, glm::vec3(40.0f, 40.0f, 150.0f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road7.Draw(ourShader);
-
-        //road8
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition8);
-        model = glm::scale(model, glm::vec3(40.0f, 40.0f, 130.0f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road8.Draw(ourShader);
-
-        //road9
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->roadPosition9);
-        model = glm::scale(model, glm::vec3(40.0f, 40.0f, 28.0f));
-        model = glm::rotate(model, glm::radians(0.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road9.Draw(ourShader);
-
-        //bez bankine prvi
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->road_without_side_Position);
-        model = glm::scale(model, glm::vec3(programState->road_without_side));
-        model = glm::rotate(model, glm::radians(225.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        road_without_side.Draw(ourShader);
-
-        //bez bankine drugi
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->road1_without_side_Position);
-        model = glm::rotate(model, glm::radians(150.0f), glm::vec3 (0.0, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(45.0f, 60.0f, 70.0f));
-        ourShader.setMat4("model", model);
-        road1_without_side.Draw(ourShader);
-
-        //skybox
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        //skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        if(noc){
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTextureNight);
-        } else{
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTextureDay);
-        }
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
-
         if (programState->ImGuiEnabled)
             DrawImGui(programState);
 
@@ -1152,14 +1211,19 @@ int main() {
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+}
+
+// camera movement of one simulation step of the given length
+// -----------------------------------------------------------
+void processMovement(GLFWwindow *window, float seconds) {
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(FORWARD, 2);
+        programState->camera.ProcessKeyboard(FORWARD, seconds);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(BACKWARD, 2);
+        programState->camera.ProcessKeyboard(BACKWARD, seconds);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(LEFT, 2);
+        programState->camera.ProcessKeyboard(LEFT, seconds);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        programState->camera.ProcessKeyboard(RIGHT, 2);
+        programState->camera.ProcessKeyboard(RIGHT, seconds);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -1228,85 +1292,53 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_N && action == GLFW_PRESS) {
         noc = !noc;
     }
+    // forward or deferred shading of the models
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        programState->deferredShading = !programState->deferredShading;
+    }
+    // occlusion culling on/off
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        programState->occlusionCulling = !programState->occlusionCulling;
+    }
+    // levels of detail on/off
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        programState->levelsOfDetail = !programState->levelsOfDetail;
+    }
+    // shadows of the directional light on/off
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        programState->shadows = !programState->shadows;
+    }
+    // vsync on/off, off lets the frame rate run free of the simulation rate
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        programState->vsync = !programState->vsync;
+        glfwSwapInterval(programState->vsync ? 1 : 0);
+    }
+    // relaxed cone stepping or the linear search for the manhole
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        programState->coneStepParallax = !programState->coneStepParallax;
+    }
+    // name the object in the middle of the screen
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        pickRequested = true;
+    }
 
 }
 
+// both loaders go through TextureCache, so a file that is already resident is never decoded twice
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return TextureCache::AcquireCubemap(faces);
 }
 
 unsigned int loadTexture(char const * path, bool gammaCorrection)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum internalFormat;
-        GLenum dataFormat;
-        if (nrComponents == 1)
-        {
-            internalFormat = dataFormat = GL_RED;
-        }
-        else if (nrComponents == 3)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-            dataFormat = GL_RGB;
-        }
-        else if (nrComponents == 4)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-            dataFormat = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    return TextureCache::Acquire(path, gammaCorrection);
+}
 
-    return textureID;
+// normal maps are stored as two channel BC5, the shaders rebuild z
+unsigned int loadNormalMap(char const * path)
+{
+    return TextureCache::Acquire(path, false, true);
 }
 
 unsigned int quadVAO = 0;
@@ -0,0 +1,266 @@
+// Headless checks of the CPU block compressor and the KTX cache files: encodes blocks, decodes them
+// again with the reference BC1/BC4/BC5 rules and checks the error stays bounded, checks the mip chain
+// Compress builds and a KtxFile round trip. Runs without a GL context; exits non-zero on failure.
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/ktx.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                            \
+    do                                                                              \
+    {                                                                               \
+        if (!(condition))                                                           \
+        {                                                                           \
+            std::printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+static void decodeBC1(const unsigned char *block, unsigned char *rgb)
+{
+    uint16_t c0 = (uint16_t)(block[0] | block[1] << 8), c1 = (uint16_t)(block[2] | block[3] << 8);
+    int palette[4][3];
+    for (int i = 0; i < 2; i++)
+    {
+        uint16_t c = i == 0 ? c0 : c1;
+        palette[i][0] = ((c >> 11) & 31) * 255 / 31;
+        palette[i][1] = ((c >> 5) & 63) * 255 / 63;
+        palette[i][2] = (c & 31) * 255 / 31;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    uint32_t indices = (uint32_t)block[4] | (uint32_t)block[5] << 8 | (uint32_t)block[6] << 16 | (uint32_t)block[7] << 24;
+    for (int t = 0; t < 16; t++)
+        for (int c = 0; c < 3; c++)
+            rgb[t * 3 + c] = (unsigned char)palette[(indices >> (2 * t)) & 3][c];
+}
+
+static void decodeBC4(const unsigned char *block, unsigned char *values)
+{
+    int palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+    if (palette[0] > palette[1])
+    {
+        for (int i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+    }
+    else
+    {
+        for (int i = 2; i < 6; i++)
+            palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+        bits |= (uint64_t)block[2 + i] << (8 * i);
+    for (int t = 0; t < 16; t++)
+        values[t] = (unsigned char)palette[(bits >> (3 * t)) & 7];
+}
+
+static void testBC1()
+{
+    std::mt19937 random(1);
+    double squaredError = 0.0;
+    int samples = 0;
+    for (int trial = 0; trial < 200; trial++)
+    {
+        // a gradient between two random colors with some noise, what photos look like up close
+        unsigned char rgba[64], decoded[48], block[8];
+        int from[3], to[3];
+        for (int c = 0; c < 3; c++)
+        {
+            from[c] = (int)(random() % 256);
+            to[c] = (int)(random() % 256);
+        }
+        for (int t = 0; t < 16; t++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int value = from[c] + (to[c] - from[c]) * t / 15 + (int)(random() % 9) - 4;
+                rgba[t * 4 + c] = (unsigned char)std::min(255, std::max(0, value));
+            }
+            rgba[t * 4 + 3] = 255;
+        }
+        TextureCompressor::EncodeBC1(rgba, block);
+        decodeBC1(block, decoded);
+        for (int t = 0; t < 16; t++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int error = std::abs((int)decoded[t * 3 + c] - (int)rgba[t * 4 + c]);
+                CHECK(error <= 48);
+                squaredError += error * error;
+                samples++;
+            }
+        }
+    }
+    double rms = std::sqrt(squaredError / samples);
+    std::printf("BC1 gradient blocks: RMS error %.2f\n", rms);
+    CHECK(rms <= 10.0);
+
+    // a flat color comes back exactly up to 565 rounding
+    unsigned char flat[64], decoded[48], block[8];
+    for (int t = 0; t < 16; t++)
+    {
+        flat[t * 4] = 200;
+        flat[t * 4 + 1] = 100;
+        flat[t * 4 + 2] = 50;
+        flat[t * 4 + 3] = 255;
+    }
+    TextureCompressor::EncodeBC1(flat, block);
+    decodeBC1(block, decoded);
+    for (int t = 0; t < 16; t++)
+    {
+        CHECK(std::abs(decoded[t * 3] - 200) <= 4);
+        CHECK(std::abs(decoded[t * 3 + 1] - 100) <= 2);
+        CHECK(std::abs(decoded[t * 3 + 2] - 50) <= 4);
+    }
+}
+
+static void testBC4()
+{
+    std::mt19937 random(2);
+    for (int trial = 0; trial < 500; trial++)
+    {
+        unsigned char values[16], decoded[16], block[8];
+        int low = (int)(random() % 256), high = (int)(random() % 256);
+        if (low > high)
+            std::swap(low, high);
+        for (int t = 0; t < 16; t++)
+            values[t] = (unsigned char)(low + (int)(random() % (unsigned int)(high - low + 1)));
+        TextureCompressor::EncodeBC4(values, block);
+        decodeBC4(block, decoded);
+        // eight evenly spaced values between the block's extremes: half a step off at most
+        int range = *std::max_element(values, values + 16) - *std::min_element(values, values + 16);
+        for (int t = 0; t < 16; t++)
+            CHECK(std::abs((int)decoded[t] - (int)values[t]) <= range / 14 + 1);
+    }
+}
+
+static void testBC5()
+{
+    // a 16x16 normal map, x and y in two channels, compressed through Compress like TextureCache does
+    const int size = 16;
+    std::vector<unsigned char> pixels(size * size * 4);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            unsigned char *texel = &pixels[(y * size + x) * 4];
+            texel[0] = (unsigned char)(128 + 100 * std::sin(x * 0.4));
+            texel[1] = (unsigned char)(128 + 100 * std::cos(y * 0.3));
+            texel[2] = 255;
+            texel[3] = 255;
+        }
+    }
+    CompressedTexture compressed;
+    TextureCompressor::Compress(pixels.data(), size, size, 4, Block_BC5, false, compressed);
+    CHECK(compressed.levels[0].size() == (size_t)(size / 4) * (size / 4) * 16);
+
+    int worst = 0;
+    for (int by = 0; by < size / 4; by++)
+    {
+        for (int bx = 0; bx < size / 4; bx++)
+        {
+            const unsigned char *block = &compressed.levels[0][(by * (size / 4) + bx) * 16];
+            unsigned char red[16], green[16];
+            decodeBC4(block, red);
+            decodeBC4(block + 8, green);
+            for (int t = 0; t < 16; t++)
+            {
+                const unsigned char *texel = &pixels[((by * 4 + t / 4) * size + bx * 4 + t % 4) * 4];
+                worst = std::max(worst, std::abs((int)red[t] - (int)texel[0]));
+                worst = std::max(worst, std::abs((int)green[t] - (int)texel[1]));
+            }
+        }
+    }
+    std::printf("BC5 normal map: worst channel error %d\n", worst);
+    CHECK(worst <= 8);
+}
+
+static void testMipChain()
+{
+    // 20x12: 20x12, 10x6, 5x3, 2x1, 1x1, blocks rounded up on every level
+    const int width = 20, height = 12;
+    std::vector<unsigned char> pixels(width * height * 3, 128);
+    CompressedTexture compressed;
+    TextureCompressor::Compress(pixels.data(), width, height, 3, Block_BC1, true, compressed);
+    CHECK(compressed.levels.size() == 5);
+    CHECK(compressed.srgb);
+    size_t total = 0;
+    for (size_t level = 0; level < compressed.levels.size(); level++)
+    {
+        int levelWidth = std::max(1, width >> (int)level), levelHeight = std::max(1, height >> (int)level);
+        size_t expected = (size_t)((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * 8;
+        CHECK(compressed.levels[level].size() == expected);
+        total += expected;
+    }
+    CHECK(compressed.Bytes() == total);
+
+    // BC4 ignores srgb, there is nothing to gamma correct in a single channel
+    std::vector<unsigned char> grey(8 * 8, 10);
+    TextureCompressor::Compress(grey.data(), 8, 8, 1, Block_BC4, true, compressed);
+    CHECK(compressed.levels.size() == 4);
+    CHECK(!compressed.srgb);
+}
+
+static void testKtxRoundTrip()
+{
+    KtxImage image;
+    image.glInternalFormat = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    image.glBaseInternalFormat = 0x1907; // GL_RGB
+    image.width = 8;
+    image.height = 4;
+    image.levels.push_back(std::vector<unsigned char>(16, 0xAB));
+    image.levels.push_back(std::vector<unsigned char>(8, 0xCD));
+    image.levels.push_back(std::vector<unsigned char>(8, 0xEF));
+    image.levels.push_back(std::vector<unsigned char>(8, 0x12));
+
+    const std::string path = "texture_compression_test.ktx";
+    const uint64_t hash = 0x0123456789ABCDEFull;
+    CHECK(KtxFile::Save(path, image, hash));
+
+    KtxImage loaded;
+    CHECK(KtxFile::Load(path, hash, loaded));
+    CHECK(loaded.glInternalFormat == image.glInternalFormat);
+    CHECK(loaded.glBaseInternalFormat == image.glBaseInternalFormat);
+    CHECK(loaded.width == image.width && loaded.height == image.height);
+    CHECK(loaded.levels == image.levels);
+
+    // a file made from some other source is rejected
+    KtxImage stale;
+    CHECK(!KtxFile::Load(path, hash + 1, stale));
+    std::remove(path.c_str());
+    CHECK(!KtxFile::Load(path, hash, stale));
+}
+
+int main()
+{
+    testBC1();
+    testBC4();
+    testBC5();
+    testMipChain();
+    testKtxRoundTrip();
+    if (failures)
+        std::printf("%d checks failed\n", failures);
+    else
+        std::printf("all checks passed\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}